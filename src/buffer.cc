@@ -4,7 +4,9 @@
 #include "buffer_manager.hh"
 #include "client.hh"
 #include "context.hh"
+#include "diff.hh"
 #include "file.hh"
+#include "file_watcher.hh"
 #include "interned_string.hh"
 #include "utils.hh"
 #include "window.hh"
@@ -14,13 +16,32 @@
 namespace Kakoune
 {
 
+static LineList make_line_list(std::vector<String> lines)
+{
+    if (lines.empty())
+        lines.emplace_back("\n");
+
+#ifdef KAK_DEBUG
+    for (auto& line : lines)
+        kak_assert(not line.empty() and line.back() == '\n');
+#endif
+    LineList res;
+    res.assign(std::move(lines));
+    return res;
+}
+
 Buffer::Buffer(String name, Flags flags, std::vector<String> lines,
-               time_t fs_timestamp)
+               FsStatus fs_status)
+    : Buffer(std::move(name), flags, make_line_list(std::move(lines)), fs_status)
+{}
+
+Buffer::Buffer(String name, Flags flags, LineList lines,
+               FsStatus fs_status)
     : m_name(flags & Flags::File ? real_path(parse_filename(name)) : std::move(name)),
       m_flags(flags | Flags::NoUndo),
       m_history(), m_history_cursor(m_history.begin()),
       m_last_save_undo_index(0),
-      m_fs_timestamp(fs_timestamp),
+      m_fs_status(fs_status),
       m_hooks(GlobalHooks::instance()),
       m_options(GlobalOptions::instance()),
       m_keymaps(GlobalKeymaps::instance())
@@ -28,15 +49,8 @@ Buffer::Buffer(String name, Flags flags, std::vector<String> lines,
     BufferManager::instance().register_buffer(*this);
     m_options.register_watcher(*this);
 
-    if (lines.empty())
-        lines.emplace_back("\n");
-
-    m_lines.reserve(lines.size());
-    for (auto& line : lines)
-    {
-        kak_assert(not line.empty() and line.back() == '\n');
-        m_lines.emplace_back(std::move(line));
-    }
+    kak_assert(not lines.empty());
+    m_lines = std::move(lines);
 
     m_changes.push_back({ Change::Insert, {0,0}, line_count(), true });
 
@@ -46,7 +60,7 @@ Buffer::Buffer(String name, Flags flags, std::vector<String> lines,
             run_hook_in_own_context("BufNew", m_name);
         else
         {
-            kak_assert(m_fs_timestamp != InvalidTime);
+            kak_assert(m_fs_status.timestamp != InvalidTime);
             run_hook_in_own_context("BufOpen", m_name);
         }
     }
@@ -63,34 +77,93 @@ Buffer::Buffer(String name, Flags flags, std::vector<String> lines,
 Buffer::~Buffer()
 {
     run_hook_in_own_context("BufClose", m_name);
+    if ((m_flags & Flags::File) and FileWatcher::has_instance())
+        FileWatcher::instance().unwatch(m_name);
 
     m_options.unregister_watcher(*this);
     BufferManager::instance().unregister_buffer(*this);
     m_values.clear();
 }
 
-void Buffer::reload(std::vector<String> lines, time_t fs_timestamp)
+void Buffer::reload(std::vector<String> lines, FsStatus fs_status)
 {
+    reload(make_line_list(std::move(lines)), fs_status);
+}
+
+void Buffer::reload(LineList lines, FsStatus fs_status)
+{
+    kak_assert(not lines.empty());
+    // diffing would need every line to be loaded
+    if (not (m_flags & Flags::NoUndo) and not lines.is_lazy() and not m_lines.is_lazy())
+        return reload_with_diff(std::move(lines), fs_status);
+
     m_changes.push_back({ Change::Erase, {0,0}, back_coord(), true });
 
     m_history.clear();
     m_current_undo_group.clear();
     m_history_cursor = m_history.begin();
+    m_unspilled_history = 0;
     m_last_save_undo_index = 0;
-    m_lines.clear();
 
-    if (lines.empty())
-        lines.emplace_back("\n");
+    kak_assert(not lines.empty());
+    m_lines = std::move(lines);
+    m_fs_status = fs_status;
 
-    m_lines.reserve(lines.size());
-    for (auto& line : lines)
+    m_changes.push_back({ Change::Insert, {0,0}, back_coord(), true });
+}
+
+// apply the differences between current and new lines as a single
+// undo group, so that only modified lines are touched and the reload
+// can be undone.
+void Buffer::reload_with_diff(LineList lines, FsStatus fs_status)
+{
+    commit_undo_group();
+
+    auto diff = find_diff((int)m_lines.size(), (int)lines.size(),
+                          [&](int i, int j) { return m_lines[i] == lines[j]; });
+
+    struct Hunk { LineCount begin, end; int new_begin, new_end; };
+    std::vector<Hunk> hunks;
+    LineCount line = 0;
+    for (auto& op : diff)
     {
-        kak_assert(not line.empty() and line.back() == '\n');
-        m_lines.emplace_back(std::move(line));
+        if (op.mode == Diff::Keep)
+        {
+            line += op.len;
+            continue;
+        }
+        if (hunks.empty() or hunks.back().end != line)
+            hunks.push_back({line, line, 0, 0});
+        auto& hunk = hunks.back();
+        if (op.mode == Diff::Remove)
+            hunk.end = line += op.len;
+        else if (hunk.new_begin == hunk.new_end)
+        {
+            hunk.new_begin = op.posB;
+            hunk.new_end = op.posB + op.len;
+        }
+        else
+            hunk.new_end += op.len;
     }
-    m_fs_timestamp = fs_timestamp;
 
-    m_changes.push_back({ Change::Insert, {0,0}, back_coord(), true });
+    // apply from the end, so that hunk coordinates stay valid
+    for (auto& hunk : reversed(hunks))
+    {
+        if (hunk.new_begin != hunk.new_end)
+        {
+            String content;
+            for (int i = hunk.new_begin; i < hunk.new_end; ++i)
+                content += lines[i];
+            insert(hunk.end == line_count() ? end() : iterator_at(hunk.end), std::move(content));
+        }
+        if (hunk.begin != hunk.end)
+            erase(iterator_at(hunk.begin),
+                  hunk.end == line_count() ? end() : iterator_at(hunk.end));
+    }
+    commit_undo_group();
+
+    m_last_save_undo_index = m_history_cursor - m_history.begin();
+    m_fs_status = fs_status;
 }
 
 String Buffer::display_name() const
@@ -106,7 +179,11 @@ bool Buffer::set_name(String name)
     if (other == nullptr or other == this)
     {
         if (m_flags & Flags::File)
+        {
+            if (FileWatcher::has_instance())
+                FileWatcher::instance().unwatch(m_name);
             m_name = real_path(name);
+        }
         else
             m_name = std::move(name);
         return true;
@@ -130,22 +207,37 @@ ByteCoord Buffer::clamp(ByteCoord coord) const
     return coord;
 }
 
+CharCount Buffer::char_count_to(ByteCoord coord) const
+{
+    auto& info = m_lines.info(coord.line);
+    return info.ascii ? CharCount{(int)coord.column} : m_lines[coord.line].char_count_to(coord.column);
+}
+
+// characters are bytes in ascii lines
+static ByteCount byte_count_to(const String& line, const LineList::LineInfo& info,
+                               CharCount character)
+{
+    return info.ascii ? ByteCount{(int)character} : line.byte_count_to(character);
+}
+
 ByteCoord Buffer::offset_coord(ByteCoord coord, CharCount offset)
 {
     auto& line = m_lines[coord.line];
-    auto character = std::max(0_char, std::min(line.char_count_to(coord.column) + offset,
-                                               line.char_length() - 1));
-    return {coord.line, line.byte_count_to(character)};
+    auto& info = m_lines.info(coord.line);
+    auto character = std::max(0_char, std::min(char_count_to(coord) + offset,
+                                               info.char_count - 1));
+    return {coord.line, byte_count_to(line, info, character)};
 }
 
 ByteCoordAndTarget Buffer::offset_coord(ByteCoordAndTarget coord, LineCount offset)
 {
-    auto character = coord.target == -1 ? m_lines[coord.line].char_count_to(coord.column) : coord.target;
+    auto character = coord.target == -1 ? char_count_to(coord) : coord.target;
     auto line = Kakoune::clamp(coord.line + offset, 0_line, line_count()-1);
     auto& content = m_lines[line];
+    auto& info = m_lines.info(line);
 
-    character = std::max(0_char, std::min(character, content.char_length() - 2));
-    return {line, content.byte_count_to(character), character};
+    character = std::max(0_char, std::min(character, info.char_count - 2));
+    return {line, byte_count_to(content, info, character), character};
 }
 
 String Buffer::string(ByteCoord begin, ByteCoord end) const
@@ -171,9 +263,11 @@ struct Buffer::Modification
 
     Type      type;
     ByteCoord coord;
-    InternedString content;
+    UndoStore::Content content;
+    // end of the inserted text, for inserts of the current undo group
+    ByteCoord end;
 
-    Modification(Type type, ByteCoord coord, InternedString content)
+    Modification(Type type, ByteCoord coord, UndoStore::Content content)
         : type(type), coord(coord), content(std::move(content)) {}
 
     Modification inverse() const
@@ -182,9 +276,36 @@ struct Buffer::Modification
     }
 };
 
+// coordinates of the end of content once inserted at coord
+static ByteCoord inserted_end(ByteCoord coord, StringView content)
+{
+    ByteCount last_eol = -1;
+    LineCount lines = 0;
+    for (ByteCount i = 0; i < content.length(); ++i)
+    {
+        if (content[i] == '\n')
+        {
+            ++lines;
+            last_eol = i;
+        }
+    }
+    if (lines == 0)
+        return { coord.line, coord.column + content.length() };
+    return { coord.line + lines, content.length() - last_eol - 1 };
+}
+
+// coordinates of coord, after text was inserted in [pos, end), pos <= coord
+static ByteCoord shifted_coord(ByteCoord coord, ByteCoord pos, ByteCoord end)
+{
+    if (coord.line != pos.line)
+        return { coord.line + end.line - pos.line, coord.column };
+    return { end.line, end.column + coord.column - pos.column };
+}
 
 void Buffer::commit_undo_group()
 {
+    compact_changes();
+
     if (m_flags & Flags::NoUndo)
         return;
 
@@ -196,9 +317,77 @@ void Buffer::commit_undo_group()
     m_history.push_back(std::move(m_current_undo_group));
     m_current_undo_group.clear();
     m_history_cursor = m_history.end();
+    m_unspilled_history = std::min(m_unspilled_history, m_history.size() - 1);
 
     if (m_history.size() < m_last_save_undo_index)
         m_last_save_undo_index = -1;
+
+    spill_undo_history();
+}
+
+void Buffer::register_change_consumer(const size_t& timestamp) const
+{
+    m_change_consumers.push_back(&timestamp);
+}
+
+void Buffer::unregister_change_consumer(const size_t& timestamp) const
+{
+    auto it = std::find(m_change_consumers.begin(), m_change_consumers.end(), &timestamp);
+    kak_assert(it != m_change_consumers.end());
+    m_change_consumers.erase(it);
+}
+
+// Changes older than the oldest registered consumer timestamp are dropped,
+// timestamps stay monotonic by keeping the number of dropped changes.
+// Compaction happens once the log doubled since the previous one, so that
+// its cost is amortized.
+void Buffer::compact_changes(size_t min_size)
+{
+    if (m_changes.size() < std::max(2 * m_compacted_size, min_size))
+        return;
+
+    const size_t current = timestamp();
+    const size_t oldest_waited = current > max_change_lag ? current - max_change_lag : 0;
+    size_t watermark = current;
+    for (auto consumer : m_change_consumers)
+    {
+        if (*consumer >= oldest_waited)
+            watermark = std::min(watermark, *consumer);
+    }
+
+    if (watermark > m_changes_offset)
+    {
+        m_changes.erase(m_changes.begin(), m_changes.begin() + (watermark - m_changes_offset));
+        m_changes_offset = watermark;
+    }
+    m_compacted_size = m_changes.size();
+}
+
+// move the text of the oldest undo groups to the undo store spill file
+// until we get back under the undo_memory_limit budget.
+void Buffer::spill_undo_history()
+{
+    const size_t limit = std::max(0, m_options["undo_memory_limit"].get<int>());
+    for (; m_unspilled_history != m_history.size() and m_undo_store.memory() > limit;
+         ++m_unspilled_history)
+    {
+        for (auto& modification : m_history[m_unspilled_history])
+        {
+            // spill file unusable, keep everything in memory
+            if (not m_undo_store.spill(modification.content))
+                return;
+        }
+    }
+}
+
+void Buffer::load_undo_group(const UndoGroup& group)
+{
+    for (auto& modification : group)
+        m_undo_store.get(modification.content);
+
+    // spill it again if needed on next commit
+    const size_t index = &group - m_history.data();
+    m_unspilled_history = std::min(m_unspilled_history, index);
 }
 
 bool Buffer::undo()
@@ -208,13 +397,175 @@ bool Buffer::undo()
     if (m_history_cursor == m_history.begin())
         return false;
 
+    load_undo_group(*(m_history_cursor - 1));
     --m_history_cursor;
 
-    for (const Modification& modification : reversed(*m_history_cursor))
-        apply_modification(modification.inverse());
+    if (not apply_undo_group(*m_history_cursor, true))
+    {
+        for (const Modification& modification : reversed(*m_history_cursor))
+            apply_modification(modification.inverse());
+    }
     return true;
 }
 
+// Multi selection edits create undo groups whose modifications are sorted
+// by position. Such groups are applied as a single batch instead of one
+// modification at a time, which would move the following lines for each
+// of them. Returns false if group is not sorted that way.
+bool Buffer::apply_undo_group(const UndoGroup& group, bool undo)
+{
+    if (group.size() < 2)
+        return false;
+
+    std::vector<BatchOp> ops;
+    ops.reserve(group.size());
+    // when redoing, modifications are sorted in increasing order, and
+    // their coordinates account for the previous ones. last_end is where
+    // the previous one ended, and last_origin the same position in the
+    // buffer before the batch.
+    ByteCoord last_end, last_origin;
+    for (size_t i = 0; i < group.size(); ++i)
+    {
+        const Modification& modification = undo ? group[group.size() - 1 - i] : group[i];
+        BatchOp op;
+        op.type = (modification.type == Modification::Insert) != undo ?
+                  BatchOp::Insert : BatchOp::Erase;
+        op.content = m_undo_store.get(modification.content);
+
+        const ByteCoord coord = modification.coord;
+        if (undo)
+            op.begin = coord; // sorted in decreasing order, no previous offset
+        else if (i == 0)
+            op.begin = coord;
+        else if (coord < last_end)
+            return false;
+        else if (coord.line == last_end.line)
+            op.begin = { last_origin.line, last_origin.column + coord.column - last_end.column };
+        else
+            op.begin = { coord.line - last_end.line + last_origin.line, coord.column };
+
+        op.end = op.type == BatchOp::Insert ? op.begin : inserted_end(op.begin, op.content);
+        if (undo and i != 0 and ops.back().begin < op.end)
+            return false;
+        // the batch does not handle the end of buffer special cases
+        if (op.end.line >= line_count() or op.end.column >= m_lines[op.end.line].length())
+            return false;
+
+        last_end = op.type == BatchOp::Insert ? inserted_end(coord, op.content) : coord;
+        last_origin = op.end;
+        ops.push_back(op);
+    }
+    if (undo)
+        std::reverse(ops.begin(), ops.end());
+
+    apply_batch(ops);
+    return true;
+}
+
+// Applies ops, sorted and not overlapping, rebuilding the touched lines in
+// a single pass. Changes are recorded as if ops were applied in order.
+void Buffer::apply_batch(const std::vector<BatchOp>& ops)
+{
+    std::vector<LineList::Replacement> replacements;
+    std::vector<String> lines;
+    // difference between the line count after and before the batch for
+    // the lines already processed
+    LineCount line_delta = 0;
+    for (size_t i = 0; i < ops.size(); )
+    {
+        // rebuild lines from the one of ops[i] to the one where the last op
+        // on the same line ends
+        const LineCount first = ops[i].begin.line;
+
+        // ops only editing the inside of the line, such as typing with
+        // several cursors, are applied in place
+        auto in_line = [first](const BatchOp& op) {
+            return op.begin.line == first and op.end.line == first and
+                   std::find(op.content.begin(), op.content.end(), '\n') == op.content.end();
+        };
+        size_t group_end = i;
+        while (group_end < ops.size() and in_line(ops[group_end]))
+            ++group_end;
+        if (group_end != i and (group_end == ops.size() or ops[group_end].begin.line != first))
+        {
+            ByteCount delta = 0;
+            for (size_t k = i; k < group_end; ++k)
+            {
+                const BatchOp& op = ops[k];
+                const ByteCount length = op.content.length();
+                const ByteCoord out{first + line_delta, op.begin.column + delta};
+                if (op.type == BatchOp::Insert)
+                {
+                    m_changes.push_back({ Change::Insert, out, {out.line, out.column + length}, false });
+                    delta += length;
+                }
+                else
+                {
+                    kak_assert(string(op.begin, op.end) == op.content);
+                    m_changes.push_back({ Change::Erase, out, {out.line, out.column + length}, false });
+                    delta -= length;
+                }
+            }
+            // from the last op so that columns stay valid
+            for (size_t k = group_end; k-- != i; )
+            {
+                const BatchOp& op = ops[k];
+                m_lines.replace_in_line(first, op.begin.column, op.end.column - op.begin.column,
+                                        op.type == BatchOp::Insert ? op.content : StringView{});
+            }
+            i = group_end;
+            continue;
+        }
+
+        ByteCoord pos{first, 0};                // in the buffer before the batch
+        ByteCoord out{first + line_delta, 0};   // in the buffer after the batch
+        const size_t first_line = lines.size();
+        String content;
+        auto append = [&](StringView text) {
+            for (auto it = text.begin(), end = text.end(); it != end; )
+            {
+                auto eol = std::find(it, end, '\n');
+                content.append(it, eol + (eol != end ? 1 : 0));
+                out.column += (int)(eol - it);
+                if (eol == end)
+                    break;
+                lines.push_back(std::move(content));
+                content = String{};
+                out = { out.line + 1, 0 };
+                it = eol + 1;
+            }
+        };
+
+        do
+        {
+            const BatchOp& op = ops[i];
+            kak_assert(op.begin.line == pos.line and op.begin >= pos);
+            append(m_lines[pos.line].substr(pos.column, op.begin.column - pos.column));
+            if (op.type == BatchOp::Insert)
+            {
+                const ByteCoord begin = out;
+                append(op.content);
+                m_changes.push_back({ Change::Insert, begin, out, false });
+            }
+            else
+            {
+                kak_assert(string(op.begin, op.end) == op.content);
+                m_changes.push_back({ Change::Erase, out, inserted_end(out, op.content), false });
+            }
+            pos = op.end;
+        }
+        while (++i < ops.size() and ops[i].begin.line == pos.line);
+        append(m_lines[pos.line].substr(pos.column));
+        kak_assert(content.empty());
+
+        const LineCount last = pos.line + 1;
+        const size_t count = lines.size() - first_line;
+        line_delta += (int)count - (int)(last - first);
+        replacements.push_back({ first, last, count });
+    }
+    m_lines.replace(replacements, std::move(lines));
+}
+
 bool Buffer::redo()
 {
     if (m_history_cursor == m_history.end())
@@ -222,8 +573,12 @@ bool Buffer::redo()
 
     kak_assert(m_current_undo_group.empty());
 
-    for (const Modification& modification : *m_history_cursor)
-        apply_modification(modification);
+    load_undo_group(*m_history_cursor);
+    if (not apply_undo_group(*m_history_cursor, false))
+    {
+        for (const Modification& modification : *m_history_cursor)
+            apply_modification(modification);
+    }
 
     ++m_history_cursor;
     return true;
@@ -233,6 +588,10 @@ void Buffer::check_invariant() const
 {
 #ifdef KAK_DEBUG
     kak_assert(not m_lines.empty());
+    m_lines.check_invariant();
+    // checking every line would load a lazy buffer entirely
+    if (m_lines.is_lazy())
+        return;
     for (auto& line : m_lines)
     {
         kak_assert(line.length() > 0);
@@ -271,6 +630,13 @@ ByteCoord Buffer::do_insert(ByteCoord pos, StringView content)
         end = ByteCoord{ line_count(), 0 };
         at_end = true;
     }
+    else if (std::find(content.begin(), content.end(), '\n') == content.end())
+    {
+        // typing inside a line, edit it in place instead of rebuilding it
+        m_lines.replace_in_line(pos.line, pos.column, 0, content);
+        begin = pos;
+        end = ByteCoord{ pos.line, pos.column + content.length() };
+    }
     else
     {
         String prefix = m_lines[pos.line].substr(0, pos.column);
@@ -301,11 +667,9 @@ ByteCoord Buffer::do_insert(ByteCoord pos, StringView content)
 
         LineCount last_line = pos.line + new_lines.size() - 1;
 
-        auto line_it = m_lines.begin() + (int)pos.line;
-        *line_it = std::move(*new_lines.begin());
-
-        m_lines.insert(line_it+1, std::make_move_iterator(new_lines.begin() + 1),
-                       std::make_move_iterator(new_lines.end()));
+        m_lines.set(pos.line, std::move(new_lines.front()));
+        m_lines.insert(pos.line + 1, { std::make_move_iterator(new_lines.begin() + 1),
+                                       std::make_move_iterator(new_lines.end()) });
 
         begin = pos;
         end = ByteCoord{ last_line, m_lines[last_line].length() - suffix.length() };
@@ -319,6 +683,15 @@ ByteCoord Buffer::do_erase(ByteCoord begin, ByteCoord end)
 {
     kak_assert(is_valid(begin));
     kak_assert(is_valid(end));
+    // the end of line is kept, the line is edited in place
+    if (begin.line == end.line and end.line < line_count() and
+        end.column < m_lines[end.line].length())
+    {
+        m_lines.replace_in_line(begin.line, begin.column, end.column - begin.column, {});
+        m_changes.push_back({ Change::Erase, begin, end, false });
+        return begin;
+    }
+
     StringView prefix = m_lines[begin.line].substr(0, begin.column);
     StringView suffix = m_lines[end.line].substr(end.column);
     String new_line = prefix + suffix;
@@ -326,13 +699,13 @@ ByteCoord Buffer::do_erase(ByteCoord begin, ByteCoord end)
     ByteCoord next;
     if (new_line.length() != 0)
     {
-        m_lines.erase(m_lines.begin() + (int)begin.line, m_lines.begin() + (int)end.line);
-        m_lines[begin.line] = std::move(new_line);
+        m_lines.erase(begin.line, end.line);
+        m_lines.set(begin.line, std::move(new_line));
         next = begin;
     }
     else
     {
-        m_lines.erase(m_lines.begin() + (int)begin.line, m_lines.begin() + (int)end.line + 1);
+        m_lines.erase(begin.line, end.line + 1);
         next = is_end(begin) ? end_coord() : ByteCoord{begin.line, 0};
     }
 
@@ -342,7 +715,7 @@ ByteCoord Buffer::do_erase(ByteCoord begin, ByteCoord end)
 
 void Buffer::apply_modification(const Modification& modification)
 {
-    StringView content = modification.content;
+    StringView content = m_undo_store.get(modification.content);
     ByteCoord coord = modification.coord;
 
     kak_assert(is_valid(coord));
@@ -380,11 +753,174 @@ BufferIterator Buffer::insert(const BufferIterator& pos, String content)
     // for undo and redo purpose it is better to use one past last line rather
     // than one past last char coord.
     auto coord = pos == end() ? ByteCoord{line_count()} : pos.coord();
-    if (not (m_flags & Flags::NoUndo))
-        m_current_undo_group.emplace_back(Modification::Insert, coord, content);
+    if (not (m_flags & Flags::NoUndo) and not extend_undo_insert(coord, content))
+    {
+        m_current_undo_group.emplace_back(Modification::Insert, coord,
+                                          m_undo_store.store(content));
+        m_current_undo_group.back().end = inserted_end(coord, content);
+    }
     return {*this, do_insert(pos.coord(), content)};
 }
 
+// Typing inserts text right after the previous insert. Instead of
+// recording a new modification, append content to the last modification
+// of the current group when it is an insert ending at coord. Only that
+// one is looked at, so that inserting before earlier modifications, like
+// reloading a buffer does, stays linear. Several cursors typing go
+// through extend_undo_inserts instead.
+//
+// Changes are still recorded one per insert: a change consumer may have
+// seen the buffer between two keystrokes, and changes_since must then
+// return only the later insert.
+bool Buffer::extend_undo_insert(ByteCoord coord, StringView content)
+{
+    if (m_current_undo_group.empty())
+        return false;
+
+    Modification& modification = m_current_undo_group.back();
+    if (modification.type != Modification::Insert or modification.end != coord or
+        not m_undo_store.append(modification.content, content))
+        return false;
+
+    modification.end = inserted_end(coord, content);
+    return true;
+}
+
+// Typing with several cursors inserts text at the end of each insert of
+// the previous keystroke. This does the same as extend_undo_insert for
+// each edit, in a single pass, when the last modifications of the current
+// group are these inserts.
+bool Buffer::extend_undo_inserts(memoryview<Edit> edits,
+                                 const std::vector<std::pair<ByteCoord, ByteCoord>>& ranges)
+{
+    const size_t count = edits.size();
+    if (m_current_undo_group.size() < count)
+        return false;
+    const size_t first = m_current_undo_group.size() - count;
+
+    // coordinates of the modifications once the previous ones are
+    // extended, old_pos being the end of the previous one before, and
+    // cur_pos after.
+    std::vector<ByteCoord> coords;
+    coords.reserve(count);
+    ByteCoord old_pos, cur_pos;
+    for (size_t i = 0; i < count; ++i)
+    {
+        const Modification& modification = m_current_undo_group[first + i];
+        if (edits[i].begin != edits[i].end or edits[i].content.empty() or
+            modification.type != Modification::Insert or
+            not m_undo_store.can_append(modification.content) or
+            (i != 0 and modification.coord < m_current_undo_group[first + i - 1].end) or
+            shifted_coord(modification.end, old_pos, cur_pos) != ranges[i].first)
+            return false;
+
+        coords.push_back(shifted_coord(modification.coord, old_pos, cur_pos));
+        old_pos = modification.end;
+        cur_pos = ranges[i].second;
+    }
+
+    for (size_t i = 0; i < count; ++i)
+    {
+        Modification& modification = m_current_undo_group[first + i];
+        m_undo_store.append(modification.content, edits[i].content);
+        modification.coord = coords[i];
+        modification.end = ranges[i].second;
+    }
+    return true;
+}
+
+std::vector<std::pair<ByteCoord, ByteCoord>> Buffer::apply_edits(memoryview<Edit> edits)
+{
+    std::vector<std::pair<ByteCoord, ByteCoord>> ranges;
+    ranges.reserve(edits.size());
+    if (edits.empty())
+        return ranges;
+
+    // maps coordinates after the previous edit, at old_pos before it, to
+    // the buffer once it is applied, where it ends at cur_pos.
+    ByteCoord old_pos, cur_pos;
+    auto current_coord = [&](ByteCoord coord) { return shifted_coord(coord, old_pos, cur_pos); };
+
+    // the batch does not handle the end of buffer special cases, apply the
+    // edits one by one instead.
+    const Edit& last = edits[edits.size() - 1];
+    if (last.end.line >= line_count() or last.end.column >= m_lines[last.end.line].length())
+    {
+        for (auto& edit : edits)
+        {
+            const ByteCoord begin = current_coord(edit.begin);
+            const ByteCoord end = current_coord(edit.end);
+            auto pos = begin != end ? erase(iterator_at(begin), iterator_at(end))
+                                    : iterator_at(begin);
+            ByteCoord content_end = pos.coord();
+            if (not edit.content.empty())
+            {
+                pos = insert(pos, edit.content);
+                content_end = m_changes.back().end;
+            }
+            ranges.emplace_back(pos.coord(), content_end);
+            old_pos = edit.end;
+            cur_pos = content_end;
+        }
+        return ranges;
+    }
+
+    // reserved so that ops can reference its strings
+    std::vector<String> erased;
+    erased.reserve(edits.size());
+    std::vector<BatchOp> ops;
+    ops.reserve(edits.size());
+    for (auto& edit : edits)
+    {
+        kak_assert(edit.begin <= edit.end and (ops.empty() or ops.back().end <= edit.begin));
+        erased.push_back(edit.begin != edit.end ? string(edit.begin, edit.end) : String{});
+        if (edit.begin != edit.end)
+            ops.push_back({ BatchOp::Erase, edit.begin, edit.end, erased.back() });
+        if (not edit.content.empty())
+            ops.push_back({ BatchOp::Insert, edit.end, edit.end, edit.content });
+    }
+
+    const size_t first_change = m_changes.size();
+    if (not ops.empty())
+        apply_batch(ops);
+
+    // apply_batch recorded a change per op
+    const Change* change = m_changes.data() + first_change;
+    for (auto& edit : edits)
+    {
+        ByteCoord begin = current_coord(edit.begin);
+        ByteCoord end = begin;
+        if (edit.begin != edit.end)
+            begin = end = (change++)->begin;
+        if (not edit.content.empty())
+        {
+            begin = change->begin;
+            end = change->end;
+            ++change;
+        }
+        ranges.emplace_back(begin, end);
+        old_pos = edit.end;
+        cur_pos = end;
+    }
+
+    if (not (m_flags & Flags::NoUndo) and not extend_undo_inserts(edits, ranges))
+    {
+        for (size_t i = 0; i < edits.size(); ++i)
+        {
+            if (not erased[i].empty())
+                m_current_undo_group.emplace_back(Modification::Erase, ranges[i].first,
+                                                  m_undo_store.store(std::move(erased[i])));
+            if (not edits[i].content.empty())
+            {
+                m_current_undo_group.emplace_back(Modification::Insert, ranges[i].first,
+                                                  m_undo_store.store(edits[i].content.str()));
+                m_current_undo_group.back().end = ranges[i].second;
+            }
+        }
+    }
+    return ranges;
+}
+
 BufferIterator Buffer::erase(BufferIterator begin, BufferIterator end)
 {
     // do not erase last \n except if we erase from the start of a line
@@ -396,7 +932,7 @@ BufferIterator Buffer::erase(BufferIterator begin, BufferIterator end)
 
     if (not (m_flags & Flags::NoUndo))
         m_current_undo_group.emplace_back(Modification::Erase, begin.coord(),
-                                          string(begin.coord(), end.coord()));
+                                          m_undo_store.store(string(begin.coord(), end.coord())));
     return {*this, do_erase(begin.coord(), end.coord())};
 }
 
@@ -407,20 +943,46 @@ bool Buffer::is_modified() const
            or not m_current_undo_group.empty();
 }
 
-void Buffer::notify_saved()
+void Buffer::notify_saved(FsStatus status)
+{
+    notify_saved(status, timestamp());
+}
+
+void Buffer::notify_saved(FsStatus status, size_t timestamp)
 {
     if (not m_current_undo_group.empty())
         commit_undo_group();
 
     m_flags &= ~Flags::New;
-    size_t history_cursor_index = m_history_cursor - m_history.begin();
-    if (m_last_save_undo_index != history_cursor_index)
-        m_last_save_undo_index = history_cursor_index;
-    m_fs_timestamp = get_fs_timestamp(m_name);
+    if (timestamp == this->timestamp())
+        m_last_save_undo_index = m_history_cursor - m_history.begin();
+    else // modified since, we do not know which undo state was saved
+        m_last_save_undo_index = -1;
+    m_fs_status = status;
+}
+
+ByteCount Buffer::byte_offset(ByteCoord coord) const
+{
+    return m_lines.line_offset(coord.line) + coord.column;
+}
+
+ByteCoord Buffer::coord_at_byte_offset(ByteCount offset) const
+{
+    if (offset <= 0)
+        return {0, 0};
+    if (offset >= m_lines.byte_count())
+        return end_coord();
+    LineCount line = m_lines.line_at_offset(offset);
+    return { line, offset - m_lines.line_offset(line) };
 }
 
 ByteCoord Buffer::advance(ByteCoord coord, ByteCount count) const
 {
+    // for long jumps, going through the line offsets is faster
+    // than walking lines
+    if (count > long_jump or count < -long_jump)
+        return coord_at_byte_offset(byte_offset(coord) + count);
+
     if (count > 0)
     {
         auto line = coord.line;
@@ -475,7 +1037,7 @@ ByteCoord Buffer::char_prev(ByteCoord coord) const
 {
     kak_assert(is_valid(coord));
     if (is_end(coord))
-        return coord = {(int)m_lines.size()-1, m_lines.back().length() - 1};
+        return coord = {line_count() - 1, m_lines.back().length() - 1};
     else if (coord.column == 0)
     {
         if (coord.line > 0)
@@ -489,16 +1051,21 @@ ByteCoord Buffer::char_prev(ByteCoord coord) const
     return coord;
 }
 
-time_t Buffer::fs_timestamp() const
+std::shared_ptr<const BufferSnapshot> Buffer::snapshot() const
+{
+    return std::make_shared<BufferSnapshot>(BufferSnapshot{timestamp(), m_lines.snapshot()});
+}
+
+const FsStatus& Buffer::fs_status() const
 {
     kak_assert(m_flags & Flags::File);
-    return m_fs_timestamp;
+    return m_fs_status;
 }
 
-void Buffer::set_fs_timestamp(time_t ts)
+void Buffer::set_fs_status(FsStatus status)
 {
     kak_assert(m_flags & Flags::File);
-    m_fs_timestamp = ts;
+    m_fs_status = status;
 }
 
 void Buffer::on_option_changed(const Option& option)
@@ -533,11 +1100,11 @@ String Buffer::debug_description() const
         res += "Fifo ";
     if (m_flags & Flags::NoUndo)
         res += "NoUndo ";
+    if (m_flags & Flags::Lazy)
+        res += m_lines.is_lazy() ? "Lazy (partially loaded) " : "Lazy ";
     res += "\n";
 
-    size_t content_size = 0;
-    for (auto& line : m_lines)
-        content_size += (int)line.length();
+    size_t content_size = (int)m_lines.byte_count();
 
     size_t additional_size = 0;
     for (auto& undo_group : m_history)
@@ -545,7 +1112,12 @@ String Buffer::debug_description() const
     additional_size += m_changes.size() * sizeof(Change);
 
     res += "  Used mem: content=" + to_string(content_size) +
-           " additional=" + to_string(additional_size) + "\n";
+           " lines=" + to_string(m_lines.memory()) +
+           " additional=" + to_string(additional_size) +
+           " undo=" + to_string(m_undo_store.memory()) +
+           " (spilled " + to_string(m_undo_store.spilled()) + ")\n";
+    res += "  Changes: " + to_string(m_changes.size()) +
+           " (compacted " + to_string(m_changes_offset) + ")\n";
     return res;
 }
 
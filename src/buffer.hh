@@ -2,11 +2,14 @@
 #define buffer_hh_INCLUDED
 
 #include "coord.hh"
+#include "file.hh"
 #include "hook_manager.hh"
 #include "option_manager.hh"
 #include "keymap_manager.hh"
+#include "line_list.hh"
 #include "safe_ptr.hh"
 #include "string.hh"
+#include "undo_store.hh"
 #include "value.hh"
 
 #include <vector>
@@ -19,8 +22,6 @@ namespace Kakoune
 
 class Buffer;
 
-constexpr time_t InvalidTime = 0;
-
 // A BufferIterator permits to iterate over the characters of a buffer
 class BufferIterator
 {
@@ -64,6 +65,13 @@ private:
     ByteCoord m_coord;
 };
 
+// Content of a buffer at a given timestamp, see Buffer::snapshot
+struct BufferSnapshot
+{
+    size_t timestamp;
+    LineList::Snapshot lines;
+};
+
 // A Buffer is a in-memory representation of a file
 //
 // The Buffer class permits to read and mutate this file
@@ -79,10 +87,12 @@ public:
         New  = 2,
         Fifo = 4,
         NoUndo = 8,
+        Lazy = 16,
     };
 
     Buffer(String name, Flags flags, std::vector<String> lines = { "\n" },
-           time_t fs_timestamp = InvalidTime);
+           FsStatus fs_status = InvalidFsStatus);
+    Buffer(String name, Flags flags, LineList lines, FsStatus fs_status);
     Buffer(const Buffer&) = delete;
     Buffer& operator= (const Buffer&) = delete;
     ~Buffer();
@@ -95,9 +105,25 @@ public:
     BufferIterator insert(const BufferIterator& pos, String content);
     BufferIterator erase(BufferIterator begin, BufferIterator end);
 
+    // replaces [begin, end) with content
+    struct Edit
+    {
+        ByteCoord  begin;
+        ByteCoord  end;
+        StringView content;
+    };
+    // Applies sorted, non overlapping edits, whose coordinates are the ones
+    // before the first of them, in a single pass over the lines. Each edit
+    // is recorded as an erase followed by an insert, applied in order.
+    // Returns the range of each edit content in the resulting buffer.
+    std::vector<std::pair<ByteCoord, ByteCoord>> apply_edits(memoryview<Edit> edits);
+
     size_t         timestamp() const;
-    time_t         fs_timestamp() const;
-    void           set_fs_timestamp(time_t ts);
+    // immutable copy of the content, sharing the buffer lines, which can
+    // be read from other threads while the buffer changes
+    std::shared_ptr<const BufferSnapshot> snapshot() const;
+    const FsStatus& fs_status() const;
+    void           set_fs_status(FsStatus status);
 
     void           commit_undo_group();
     bool           undo();
@@ -114,6 +140,10 @@ public:
     ByteCoord      char_next(ByteCoord coord) const;
     ByteCoord      char_prev(ByteCoord coord) const;
 
+    // byte offset of coord from the start of the buffer, and the reverse
+    ByteCount      byte_offset(ByteCoord coord) const;
+    ByteCoord      coord_at_byte_offset(ByteCount offset) const;
+
     ByteCoord      back_coord() const;
     ByteCoord      end_coord() const;
 
@@ -128,6 +158,17 @@ public:
 
     const String&  operator[](LineCount line) const
     { return m_lines[line]; }
+    const LineList::LineInfo& line_info(LineCount line) const
+    { return m_lines.info(line); }
+    // number of characters before coord in its line
+    CharCount      char_count_to(ByteCoord coord) const;
+
+    // packs the lines that were not accessed recently to save memory,
+    // which invalidates the references returned by operator[]. It is done
+    // when idle for buffers which are not displayed, see InputModes::Normal.
+    void           pack_lines() { m_lines.pack(); }
+    // loads the lines of a lazy buffer that were not accessed yet
+    void           load_lines() const { m_lines.load_all(); }
 
     // returns an iterator at given coordinates. clamp line_and_column
     BufferIterator iterator_at(ByteCoord coord) const;
@@ -146,7 +187,9 @@ public:
     bool is_modified() const;
 
     // notify the buffer that it was saved in the current state
-    void notify_saved();
+    void notify_saved(FsStatus status);
+    // notify the buffer that it was saved in its state at given timestamp
+    void notify_saved(FsStatus status, size_t timestamp);
 
     OptionManager&       options()       { return m_options; }
     const OptionManager& options() const { return m_options; }
@@ -159,7 +202,8 @@ public:
 
     void run_hook_in_own_context(const String& hook_name, const String& param);
 
-    void reload(std::vector<String> lines, time_t fs_timestamp = InvalidTime);
+    void reload(std::vector<String> lines, FsStatus fs_status = InvalidFsStatus);
+    void reload(LineList lines, FsStatus fs_status);
 
     void check_invariant() const;
 
@@ -172,24 +216,33 @@ public:
         bool at_end;
     };
     memoryview<Change> changes_since(size_t timestamp) const;
+    // false when the changes following timestamp were compacted away, the
+    // consumer must then resynchronize from the buffer content
+    bool changes_available_since(size_t timestamp) const;
+
+    // consumers of changes_since register their timestamp, the changes
+    // following the oldest registered one are kept when compacting
+    void register_change_consumer(const size_t& timestamp) const;
+    void unregister_change_consumer(const size_t& timestamp) const;
+
+    // drops the changes registered consumers do not need anymore, once
+    // there are at least min_size of them. Consumers lagging more than
+    // max_change_lag changes behind are not waited for. Unregistered
+    // timestamps may not be used after that.
+    void compact_changes(size_t min_size = min_compact_size);
 
     String debug_description() const;
 private:
 
     void on_option_changed(const Option& option) override;
 
-    struct LineList : std::vector<String>
-    {
-        [[gnu::always_inline]]
-        String& operator[](LineCount line)
-        { return std::vector<String>::operator[]((int)line); }
-
-        [[gnu::always_inline]]
-        const String& operator[](LineCount line) const
-        { return std::vector<String>::operator[]((int)line); }
-    };
     LineList m_lines;
 
+    // advance and distance walk lines up to these limits, and use the
+    // line offsets for longer jumps
+    static constexpr int long_jump = 16384;
+    static constexpr int long_jump_lines = 256;
+
     ByteCoord do_insert(ByteCoord pos, StringView content);
     ByteCoord do_erase(ByteCoord begin, ByteCoord end);
 
@@ -200,18 +253,52 @@ private:
     using  UndoGroup = std::vector<Modification>;
     friend class UndoGroupOptimizer;
 
+    // declared before the history, whose modifications reference it
+    UndoStore                        m_undo_store;
     std::vector<UndoGroup>           m_history;
     std::vector<UndoGroup>::iterator m_history_cursor;
     UndoGroup                        m_current_undo_group;
+    // groups before this one have been spilled
+    size_t                           m_unspilled_history = 0;
 
     void apply_modification(const Modification& modification);
     void revert_modification(const Modification& modification);
+    void spill_undo_history();
+    // reads back the spilled text of group, so that applying it cannot
+    // fail halfway through
+    void load_undo_group(const UndoGroup& group);
+
+    // a modification with its range in the coordinates of the buffer
+    // before the batch it is part of is applied
+    struct BatchOp
+    {
+        enum Type { Insert, Erase };
+        Type       type;
+        ByteCoord  begin;
+        ByteCoord  end;
+        StringView content;
+    };
+    void apply_batch(const std::vector<BatchOp>& ops);
+    bool apply_undo_group(const UndoGroup& group, bool undo);
+    bool extend_undo_insert(ByteCoord coord, StringView content);
+    bool extend_undo_inserts(memoryview<Edit> edits,
+                             const std::vector<std::pair<ByteCoord, ByteCoord>>& ranges);
+
+    void reload_with_diff(LineList lines, FsStatus fs_status);
 
     size_t m_last_save_undo_index;
 
     std::vector<Change> m_changes;
+    // timestamp of the first change in m_changes
+    size_t m_changes_offset = 0;
+    // m_changes size after the last compaction
+    size_t m_compacted_size = 0;
+    mutable std::vector<const size_t*> m_change_consumers;
+
+    static constexpr size_t min_compact_size = 4096;
+    static constexpr size_t max_change_lag = 1024 * 1024;
 
-    time_t m_fs_timestamp;
+    FsStatus m_fs_status;
 
     OptionManager m_options;
     HookManager   m_hooks;
@@ -13,6 +13,7 @@ inline char Buffer::byte_at(ByteCoord c) const
     return m_lines[c.line][c.column];
 }
 
+[[gnu::always_inline]]
 inline ByteCoord Buffer::next(ByteCoord coord) const
 {
     if (coord.column < m_lines[coord.line].length() - 1)
@@ -43,6 +44,8 @@ inline ByteCount Buffer::distance(ByteCoord begin, ByteCoord end) const
 {
     if (begin > end)
         return -distance(end, begin);
+    if (end.line - begin.line > long_jump_lines)
+        return byte_offset(end) - byte_offset(begin);
     ByteCount res = 0;
     for (LineCount l = begin.line; l <= end.line; ++l)
     {
@@ -86,20 +89,26 @@ inline BufferIterator Buffer::end() const
 [[gnu::always_inline]]
 inline LineCount Buffer::line_count() const
 {
-    return LineCount(m_lines.size());
+    return m_lines.size();
 }
 
 inline size_t Buffer::timestamp() const
 {
-    return m_changes.size();
+    return m_changes_offset + m_changes.size();
 }
 
 inline memoryview<Buffer::Change> Buffer::changes_since(size_t timestamp) const
 {
-    return { m_changes.data() + timestamp,
+    kak_assert(changes_available_since(timestamp));
+    return { m_changes.data() + (timestamp - m_changes_offset),
              m_changes.data() + m_changes.size() };
 }
 
+inline bool Buffer::changes_available_since(size_t timestamp) const
+{
+    return timestamp >= m_changes_offset;
+}
+
 inline ByteCoord Buffer::back_coord() const
 {
     return { line_count() - 1, m_lines.back().length() - 1 };
@@ -5,6 +5,10 @@
 
 #include <sys/select.h>
 
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
 namespace Kakoune
 {
 
@@ -12,6 +16,10 @@ CharCount get_column(const Buffer& buffer,
                      CharCount tabstop, ByteCoord coord)
 {
     auto& line = buffer[coord.line];
+    auto& info = buffer.line_info(coord.line);
+    if (info.ascii and not info.has_tab)
+        return (int)std::min(coord.column, line.length());
+
     auto col = 0_char;
     for (auto it = line.begin();
          it != line.end() and coord.column > (int)(it - line.begin());
@@ -25,8 +33,77 @@ CharCount get_column(const Buffer& buffer,
     return col;
 }
 
+// returns the first \r or \n in [begin, end), or end
+static const char* find_eol(const char* begin, const char* end)
+{
+#ifdef __SSE2__
+    const __m128i lf = _mm_set1_epi8('\n');
+    const __m128i cr = _mm_set1_epi8('\r');
+    for (; end - begin >= 16; begin += 16)
+    {
+        const __m128i chunk = _mm_loadu_si128((const __m128i*)begin);
+        const int mask = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(chunk, lf),
+                                                        _mm_cmpeq_epi8(chunk, cr)));
+        if (mask != 0)
+            return begin + __builtin_ctz(mask);
+    }
+#endif
+    while (begin != end and *begin != '\n' and *begin != '\r')
+        ++begin;
+    return begin;
+}
+
+// first line start after pos, lines ending with \n, \r\n or \r
+static const char* next_line(const char* pos, const char* end, bool& crlf)
+{
+    const char* eol = find_eol(pos, end);
+    if (eol == end)
+        return end;
+    if (*eol == '\r' and eol + 1 != end and *(eol+1) == '\n')
+    {
+        crlf = true;
+        return eol + 2;
+    }
+    return eol + 1;
+}
+
+// below that size, splitting lines is not worth starting threads
+static constexpr size_t parallel_split_size = 4 * 1024 * 1024;
+
+static std::vector<const char*> split_lines(const char* begin, const char* end, bool& crlf)
+{
+    // cut data in chunks starting on line starts, each of them is then
+    // split independently.
+    const size_t chunk_count = parallel_thread_count(end - begin, parallel_split_size);
+    std::vector<const char*> chunk_begins{begin};
+    for (size_t i = 1; i < chunk_count; ++i)
+    {
+        const char* pos = std::max(chunk_begins.back(),
+                                   begin + (end - begin) * i / chunk_count);
+        chunk_begins.push_back(pos == begin ? pos : next_line(pos-1, end, crlf));
+    }
+    chunk_begins.push_back(end);
+
+    std::vector<std::vector<const char*>> chunk_starts(chunk_count);
+    std::unique_ptr<bool[]> chunk_crlf{new bool[chunk_count]()};
+    run_parallel(chunk_count, [&](size_t i) {
+        auto& starts = chunk_starts[i];
+        for (const char* pos = chunk_begins[i]; pos < chunk_begins[i+1];
+             pos = next_line(pos, end, chunk_crlf[i]))
+            starts.push_back(pos);
+    });
+
+    std::vector<const char*> line_starts = std::move(chunk_starts[0]);
+    for (size_t i = 1; i < chunk_count; ++i)
+        line_starts.insert(line_starts.end(), chunk_starts[i].begin(), chunk_starts[i].end());
+    for (size_t i = 0; i < chunk_count; ++i)
+        crlf = crlf or chunk_crlf[i];
+    return line_starts;
+}
+
 Buffer* create_buffer_from_data(StringView data, StringView name,
-                                Buffer::Flags flags, time_t fs_timestamp)
+                                Buffer::Flags flags, FsStatus fs_status,
+                                LineList::LazyReader reader)
 {
     bool bom = false, crlf = false;
 
@@ -38,39 +115,36 @@ Buffer* create_buffer_from_data(StringView data, StringView name,
         pos = data.begin() + 3;
     }
 
-    std::vector<String> lines;
-    while (pos < data.end())
-    {
-        const char* line_end = pos;
-        while (line_end < data.end() and *line_end != '\r' and *line_end != '\n')
-             ++line_end;
-
-        // this should happen only when opening a file which has no
-        // end of line as last character.
-        if (line_end == data.end())
-        {
-            lines.emplace_back(pos, line_end);
-            lines.back() += '\n';
-            break;
-        }
-
-        lines.emplace_back(pos, line_end + 1);
-        lines.back().back() = '\n';
+    auto line_starts = split_lines(pos, data.end(), crlf);
+    const bool lazy = (bool)reader and not line_starts.empty();
 
-        if (line_end+1 != data.end() and *line_end == '\r' and *(line_end+1) == '\n')
-        {
-            crlf = true;
-            pos = line_end + 2;
-        }
+    LineList line_list;
+    if (lazy)
+    {
+        line_list.assign(data, line_starts, std::move(reader));
+        flags |= Buffer::Flags::Lazy;
+    }
+    else
+    {
+        // without reader, lines are copied packed
+        if (line_starts.empty())
+            line_list.assign({ "\n" });
         else
-            pos = line_end + 1;
+            line_list.assign(data, line_starts, nullptr);
+        flags &= ~Buffer::Flags::Lazy;
     }
 
     Buffer* buffer = BufferManager::instance().get_buffer_ifp(name);
     if (buffer)
-        buffer->reload(std::move(lines), fs_timestamp);
+    {
+        buffer->reload(std::move(line_list), fs_status);
+        if (lazy)
+            buffer->flags() |= Buffer::Flags::Lazy;
+        else
+            buffer->flags() &= ~Buffer::Flags::Lazy;
+    }
     else
-        buffer = new Buffer{name, flags, std::move(lines), fs_timestamp};
+        buffer = new Buffer{name, flags, std::move(line_list), fs_status};
 
     OptionManager& options = buffer->options();
     options.get_local_option("eolformat").set<String>(crlf ? "crlf" : "lf");
@@ -79,46 +153,65 @@ Buffer* create_buffer_from_data(StringView data, StringView name,
     return buffer;
 }
 
-Buffer* create_fifo_buffer(String name, int fd, bool scroll)
+Buffer* create_fifo_buffer(String name, int fd, bool scroll, LineCount max_lines)
 {
     Buffer* buffer = new Buffer(std::move(name), Buffer::Flags::Fifo | Buffer::Flags::NoUndo);
 
-    auto watcher = new FDWatcher(fd, [buffer, scroll](FDWatcher& watcher) {
-        constexpr size_t buffer_size = 2048;
+    auto watcher = new FDWatcher(fd, [buffer, scroll, max_lines](FDWatcher& watcher) {
+        constexpr size_t read_size = 64 * 1024;
         // if we read data slower than it arrives in the fifo, limiting the
-        // iteration number allows us to go back go back to the event loop and
+        // amount of data read allows us to go back to the event loop and
         // handle other events sources (such as input)
-        size_t loops = 16;
-        char data[buffer_size];
+        constexpr size_t read_budget = 1024 * 1024;
+        String data;
         const int fifo = watcher.fd();
         timeval tv{ 0, 0 };
         fd_set  rfds;
         ssize_t count = 0;
         do
         {
-            count = read(fifo, data, buffer_size);
+            const size_t size = data.size();
+            data.resize(size + read_size);
+            count = read(fifo, &data[0_byte] + size, read_size);
+            data.resize(size + std::max<ssize_t>(count, 0));
+
+            FD_ZERO(&rfds);
+            FD_SET(fifo, &rfds);
+        }
+        while (count > 0 and data.size() < read_budget and
+               select(fifo+1, &rfds, nullptr, nullptr, &tv) == 1);
+
+        if (not data.empty())
+        {
             auto pos = buffer->end()-1;
 
             bool prevent_scrolling = pos == buffer->begin() and not scroll;
             if (prevent_scrolling)
                 ++pos;
 
-            buffer->insert(pos, String(data, data+count));
+            const bool ends_with_eol = data.back() == '\n';
+            buffer->insert(pos, std::move(data));
 
-            if (count > 0 and prevent_scrolling)
+            if (prevent_scrolling)
             {
                 buffer->erase(buffer->begin(), buffer->begin()+1);
                 // in the other case, the buffer will have automatically
                 // inserted a \n to guarantee its invariant.
-                if (data[count-1] == '\n')
+                if (ends_with_eol)
                     buffer->insert(buffer->end(), "\n");
             }
 
-            FD_ZERO(&rfds);
-            FD_SET(fifo, &rfds);
+            // drop the oldest lines, the erase change keeps selections
+            // and highlighters in sync
+            const LineCount line_count = buffer->line_count();
+            if (max_lines > 0 and line_count > max_lines)
+                buffer->erase(buffer->begin(),
+                              buffer->iterator_at({line_count - max_lines, 0}));
+
+            // undo groups of fifo buffers, where compaction usually
+            // happens, are not committed while reading
+            buffer->compact_changes();
         }
-        while (--loops and count > 0 and
-               select(fifo+1, &rfds, nullptr, nullptr, &tv) == 1);
 
         if (count <= 0)
         {
@@ -12,12 +12,6 @@ inline String content(const Buffer& buffer, const Selection& range)
     return buffer.string(range.min(), buffer.char_next(range.max()));
 }
 
-inline BufferIterator erase(Buffer& buffer, const Selection& range)
-{
-    return buffer.erase(buffer.iterator_at(range.min()),
-                        buffer.iterator_at(buffer.char_next(range.max())));
-}
-
 inline CharCount char_length(const Buffer& buffer, const Selection& range)
 {
     return utf8::distance(buffer.iterator_at(range.min()),
@@ -27,11 +21,17 @@ inline CharCount char_length(const Buffer& buffer, const Selection& range)
 CharCount get_column(const Buffer& buffer,
                      CharCount tabstop, ByteCoord coord);
 
-Buffer* create_fifo_buffer(String name, int fd, bool scroll = false);
+// when max_lines is not 0, the oldest lines are erased so that the
+// buffer never holds more than max_lines lines
+Buffer* create_fifo_buffer(String name, int fd, bool scroll = false,
+                           LineCount max_lines = 0);
 
+// if reader is given, lines are only read with it when first accessed,
+// see LineList::assign
 Buffer* create_buffer_from_data(StringView data, StringView name,
                                 Buffer::Flags flags,
-                                time_t fs_timestamp = InvalidTime);
+                                FsStatus fs_status = InvalidFsStatus,
+                                LineList::LazyReader reader = {});
 
 }
 
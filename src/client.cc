@@ -5,7 +5,9 @@
 #include "buffer_manager.hh"
 #include "user_interface.hh"
 #include "file.hh"
+#include "file_watcher.hh"
 #include "remote.hh"
+#include "search_index.hh"
 #include "client_manager.hh"
 #include "window.hh"
 
@@ -48,7 +50,7 @@ void Client::print_status(DisplayLine status_line)
 DisplayLine Client::generate_mode_line() const
 {
     auto pos = context().selections().main().cursor();
-    auto col = context().buffer()[pos.line].char_count_to(pos.column);
+    auto col = context().buffer().char_count_to(pos);
 
     DisplayLine status;
     Face info_face = get_face("Information");
@@ -77,6 +79,7 @@ DisplayLine Client::generate_mode_line() const
 void Client::change_buffer(Buffer& buffer)
 {
     auto& client_manager = ClientManager::instance();
+    Buffer& previous = context().buffer();
     client_manager.add_free_window(std::move(m_window),
                                    std::move(context().selections()));
     WindowAndSelections ws = client_manager.get_free_window(buffer);
@@ -85,6 +88,10 @@ void Client::change_buffer(Buffer& buffer)
     context().set_window(*m_window);
     m_window->set_dimensions(ui().dimensions());
     m_window->hooks().run_hook("WinDisplay", buffer.name(), context());
+
+    // the search index is only useful for the displayed buffers
+    if (&previous != &buffer and not client_manager.is_displayed(previous))
+        SearchIndex::drop(previous);
 }
 
 void Client::redraw_ifn()
@@ -133,9 +140,27 @@ void Client::check_buffer_fs_timestamp()
         return;
 
     const String& filename = buffer.name();
-    time_t ts = get_fs_timestamp(filename);
-    if (ts == InvalidTime or ts == buffer.fs_timestamp())
+    FileWatcher& watcher = FileWatcher::instance();
+    if (not watcher.may_have_changed(filename))
+        return;
+
+    // the file is being written from the buffer, its status is updated
+    // once the write is done
+    if (background_write_in_progress(filename))
         return;
+
+    timespec ts = get_fs_timestamp(filename);
+    if (ts == InvalidTime or ts == buffer.fs_status().timestamp)
+        return watcher.clear_changed(filename);
+
+    // the file might only have been touched
+    FsStatus status = get_fs_status(filename);
+    if (is_file_touched(buffer, filename, status))
+    {
+        buffer.set_fs_status(status);
+        return watcher.clear_changed(filename);
+    }
+
     if (reload == Ask)
     {
         CharCoord pos = context().window().dimensions();
@@ -147,7 +172,7 @@ void Client::check_buffer_fs_timestamp()
             pos, get_face("Information"), MenuStyle::Prompt);
 
         m_input_handler.on_next_key(KeymapMode::None,
-                                   [this, filename, ts](Key key, Context& context) {
+                                   [this, filename, status](Key key, Context& context) {
             Buffer* buf = BufferManager::instance().get_buffer_ifp(filename);
             m_ui->info_hide();
             // buffer got deleted while waiting for the key, do nothing
@@ -157,7 +182,7 @@ void Client::check_buffer_fs_timestamp()
                 reload_buffer(context, filename);
             else if (key == 'k' or key == 'n')
             {
-                buf->set_fs_timestamp(ts);
+                buf->set_fs_status(status);
                 print_status({ "'" + buf->display_name() + "' kept",
                                get_face("Information") });
             }
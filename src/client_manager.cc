@@ -2,6 +2,7 @@
 
 #include "buffer_manager.hh"
 #include "command_manager.hh"
+#include "debug.hh"
 #include "event_manager.hh"
 #include "face_registry.hh"
 #include "file.hh"
@@ -108,6 +109,13 @@ void ClientManager::add_free_window(std::unique_ptr<Window>&& window, SelectionL
     m_free_windows.push_back({ std::move(window), SelectionList{ std::move(selections) }, buffer.timestamp() });
 }
 
+bool ClientManager::is_displayed(const Buffer& buffer) const
+{
+    return std::any_of(m_clients.begin(), m_clients.end(),
+                       [&](const std::unique_ptr<Client>& client)
+                       { return &client->context().buffer() == &buffer; });
+}
+
 void ClientManager::ensure_no_client_uses_buffer(Buffer& buffer)
 {
     for (auto& client : m_clients)
@@ -167,7 +175,18 @@ Client& ClientManager::get_client(const String& name)
 void ClientManager::redraw_clients() const
 {
     for (auto& client : m_clients)
-        client->redraw_ifn();
+    {
+        // lazy buffer lines can fail to be read, if their file was truncated
+        try
+        {
+            client->redraw_ifn();
+        }
+        catch (Kakoune::runtime_error& error)
+        {
+            write_debug("error while redrawing client: "_str + error.what());
+            client->context().print_status({ error.what(), get_face("Error") });
+        }
+    }
 }
 
 void ClientManager::clear_mode_trashes() const
@@ -29,6 +29,8 @@ public:
     size_t count() const { return m_clients.size(); }
 
     void    ensure_no_client_uses_buffer(Buffer& buffer);
+    // true if a client window displays buffer
+    bool    is_displayed(const Buffer& buffer) const;
 
     WindowAndSelections get_free_window(Buffer& buffer);
     void add_free_window(std::unique_ptr<Window>&& window, SelectionList selections);
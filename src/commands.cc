@@ -34,7 +34,8 @@ namespace Kakoune
 namespace
 {
 
-Buffer* open_fifo(const String& name , const String& filename, bool scroll)
+Buffer* open_fifo(const String& name , const String& filename, bool scroll,
+                  LineCount max_lines)
 {
     int fd = open(parse_filename(filename).c_str(), O_RDONLY);
     fcntl(fd, F_SETFD, FD_CLOEXEC);
@@ -43,7 +44,7 @@ Buffer* open_fifo(const String& name , const String& filename, bool scroll)
 
     BufferManager::instance().delete_buffer_if_exists(name);
 
-    return create_fifo_buffer(std::move(name), fd, scroll);
+    return create_fifo_buffer(std::move(name), fd, scroll, max_lines);
 }
 
 const PerArgumentCommandCompleter filename_completer({
@@ -103,10 +104,15 @@ void edit(const ParametersParser& parser, Context& context)
             buffer = new Buffer(name, Buffer::Flags::None);
         }
         else if (parser.has_option("fifo"))
-            buffer = open_fifo(name, parser.option_value("fifo"), parser.has_option("scroll"));
+        {
+            const int max_lines = parser.has_option("maxlines") ?
+                std::max(0, str_to_int(parser.option_value("maxlines"))) : 0;
+            buffer = open_fifo(name, parser.option_value("fifo"),
+                               parser.has_option("scroll"), max_lines);
+        }
         else
         {
-            buffer = create_buffer_from_file(name);
+            buffer = create_buffer_from_file(name, parser.has_option("lazy"));
             if (not buffer)
             {
                 if (parser.has_option("existing"))
@@ -144,7 +150,9 @@ ParameterDesc edit_params{
     SwitchMap{ { "existing", { false, "fail if the file does not exists, do not open a new file" } },
                { "scratch", { false, "create a scratch buffer, not linked to a file" } },
                { "fifo", { true, "create a buffer reading its content from a named fifo" } },
-               { "scroll", { false, "place the initial cursor so that the fifo will scroll to show new data" } } },
+               { "scroll", { false, "place the initial cursor so that the fifo will scroll to show new data" } },
+               { "maxlines", { true, "only keep that many lines of the fifo content, dropping the oldest ones" } },
+               { "lazy", { false, "only read lines of the file when accessed, the file must not be modified while loading" } } },
     ParameterDesc::Flags::None, 0, 3
 };
 
@@ -178,14 +186,17 @@ void write_buffer(const ParametersParser& parser, Context& context)
     String filename = parser.positional_count() == 0 ? buffer.name()
                                      : parse_filename(parser[0]);
 
-    write_buffer_to_file(buffer, filename);
+    write_buffer_to_file(buffer, filename, parser.has_option("async"));
 }
 
 const CommandDesc write_cmd = {
     "write",
     "w",
     "write [filename]: write the current buffer to it's file or to [filename] if specified",
-    single_optional_name_param,
+    ParameterDesc{
+        SwitchMap{ { "async", { false, "write in the background, BufWritePost hooks run once done" } } },
+        ParameterDesc::Flags::None, 0, 1
+    },
     CommandFlags::None,
     filename_completer,
     write_buffer,
@@ -0,0 +1,116 @@
+#ifndef diff_hh_INCLUDED
+#define diff_hh_INCLUDED
+
+#include <algorithm>
+#include <vector>
+
+namespace Kakoune
+{
+
+struct Diff
+{
+    enum Mode { Keep, Add, Remove };
+    Mode mode;
+    int  len;
+    int  posB; // position in b of the first added element
+};
+
+// Myers' O(ND) difference algorithm, returns the operations transforming
+// a into b, eq(i, j) comparing a[i] and b[j].
+//
+// Common prefix and suffix are trimmed first. If more than max_cost
+// additions and removals are needed, the remaining part of a is replaced
+// with the remaining part of b instead of searching for a minimal diff.
+template<typename Equal>
+std::vector<Diff> find_diff(int len_a, int len_b, Equal eq, int max_cost = 1024)
+{
+    std::vector<Diff> res;
+    auto push = [&res](Diff::Mode mode, int len, int posB) {
+        if (len == 0)
+            return;
+        if (not res.empty() and res.back().mode == mode)
+            res.back().len += len;
+        else
+            res.push_back({mode, len, posB});
+    };
+
+    int prefix = 0;
+    while (prefix < len_a and prefix < len_b and eq(prefix, prefix))
+        ++prefix;
+    int suffix = 0;
+    while (suffix < len_a - prefix and suffix < len_b - prefix and
+           eq(len_a - suffix - 1, len_b - suffix - 1))
+        ++suffix;
+
+    const int n = len_a - prefix - suffix;
+    const int m = len_b - prefix - suffix;
+    const int max_d = std::min(n + m, max_cost);
+
+    // trace[d][k + d] is the furthest x reached on diagonal k with d edits
+    std::vector<std::vector<int>> trace;
+    bool found = n == 0 and m == 0;
+    for (int d = 0; d <= max_d and not found; ++d)
+    {
+        trace.emplace_back(2 * d + 1);
+        auto& v = trace.back();
+        auto prev = [&](int k) { return trace[d-1][k + d - 1]; };
+        for (int k = -d; k <= d; k += 2)
+        {
+            int x = 0;
+            if (d != 0)
+                x = (k == -d or (k != d and prev(k-1) < prev(k+1))) ? prev(k+1) : prev(k-1) + 1;
+            int y = x - k;
+            while (x < n and y < m and eq(prefix + x, prefix + y))
+                ++x, ++y;
+            v[k + d] = x;
+            if (x >= n and y >= m)
+            {
+                found = true;
+                break;
+            }
+        }
+    }
+
+    push(Diff::Keep, prefix, 0);
+    if (not found)
+    {
+        push(Diff::Remove, n, 0);
+        push(Diff::Add, m, prefix);
+    }
+    else if (n != 0 or m != 0)
+    {
+        // walk back the trace, collecting operations in reverse order
+        std::vector<Diff> ops;
+        int x = n, y = m;
+        for (int d = (int)trace.size() - 1; d > 0; --d)
+        {
+            auto prev = [&](int k) { return trace[d-1][k + d - 1]; };
+            const int k = x - y;
+            const bool down = k == -d or (k != d and prev(k-1) < prev(k+1));
+            const int prev_k = down ? k + 1 : k - 1;
+            const int prev_x = prev(prev_k);
+            const int prev_y = prev_x - prev_k;
+            const int mid_x = down ? prev_x : prev_x + 1;
+            if (x != mid_x)
+                ops.push_back({Diff::Keep, x - mid_x, 0});
+            if (down)
+                ops.push_back({Diff::Add, 1, prefix + prev_y});
+            else
+                ops.push_back({Diff::Remove, 1, 0});
+            x = prev_x;
+            y = prev_y;
+        }
+        if (x != 0)
+            ops.push_back({Diff::Keep, x, 0});
+
+        for (auto it = ops.rbegin(); it != ops.rend(); ++it)
+            push(it->mode, it->len, it->posB);
+    }
+    push(Diff::Keep, suffix, 0);
+
+    return res;
+}
+
+}
+
+#endif // diff_hh_INCLUDED
@@ -51,6 +51,11 @@ public:
         switch (m_type)
         {
             case BufferRange:
+               // in an ascii line, characters are bytes
+               if (m_end.line == m_begin.line + (m_end.column == 0 ? 1 : 0) and
+                   m_buffer->line_info(m_begin.line).ascii)
+                   return (int)(m_end.column == 0 ? (*m_buffer)[m_begin.line].length() - m_begin.column
+                                                  : m_end.column - m_begin.column);
                return utf8::distance(m_buffer->iterator_at(m_begin),
                                      m_buffer->iterator_at(m_end));
             case Text:
@@ -6,6 +6,7 @@
 #include "buffer_utils.hh"
 #include "completion.hh"
 #include "debug.hh"
+#include "event_manager.hh"
 #include "unicode.hh"
 
 #include <errno.h>
@@ -15,6 +16,8 @@
 #include <fcntl.h>
 #include <unistd.h>
 #include <dirent.h>
+#include <limits>
+#include <thread>
 
 namespace Kakoune
 {
@@ -96,18 +99,45 @@ String compact_path(StringView filename)
     return filename.str();
 }
 
+// reads directly into the returned string, sized from the remaining file
+// size when known, and growing geometrically otherwise. Files such as the
+// procfs ones report a size of 0, so we never start below min_read_size.
 String read_fd(int fd)
 {
+    constexpr size_t min_read_size = 64 * 1024;
+    size_t capacity = min_read_size;
+    struct stat st;
+    if (fstat(fd, &st) == 0 and S_ISREG(st.st_mode))
+    {
+        const off_t pos = lseek(fd, 0, SEEK_CUR);
+        // one more byte so that the end of file is seen without growing
+        if (pos != -1 and st.st_size >= pos)
+            capacity = std::max(min_read_size, (size_t)(st.st_size - pos + 1));
+    }
+
     String content;
-    char buf[256];
+    content.resize(capacity);
+    size_t size = 0;
     while (true)
     {
-        ssize_t size = read(fd, buf, 256);
-        if (size == -1 or size == 0)
-            break;
+        if (size == content.size())
+            content.resize(content.size() * 2);
 
-        content += String(buf, buf + size);
+        ssize_t count = read(fd, &content[0_byte] + size, content.size() - size);
+        if (count == 0)
+            break;
+        if (count == -1)
+        {
+            if (errno == EINTR)
+                continue;
+            throw runtime_error("read error: "_str + strerror(errno));
+        }
+        size += count;
     }
+    content.resize(size);
+    // do not keep the unused part of a grown buffer around
+    if (content.capacity() / 2 > size)
+        content.shrink_to_fit();
     return content;
 }
 
@@ -126,7 +156,39 @@ String read_file(StringView filename)
     return read_fd(fd);
 }
 
-Buffer* create_buffer_from_file(String filename)
+static timespec get_mtime(const struct stat& st)
+{
+#if defined(__APPLE__)
+    return st.st_mtimespec;
+#else
+    return st.st_mtim;
+#endif
+}
+
+// file content is hashed by blocks, so that it can be done while writing it
+static constexpr int hash_block_size = 64 * 1024;
+
+static size_t hash_block(size_t hash, const char* data, int len)
+{
+    return (hash ^ hash_data(data, len)) * 1099511628211ull;
+}
+
+static size_t hash_file_data(StringView data)
+{
+    size_t hash = 0;
+    for (int pos = 0; pos < (int)data.length(); pos += hash_block_size)
+        hash = hash_block(hash, data.data() + pos,
+                          std::min(hash_block_size, (int)data.length() - pos));
+    return hash;
+}
+
+// sizes are stored in a ByteCount, bigger files cannot be loaded
+static bool is_too_big(const struct stat& st)
+{
+    return st.st_size > std::numeric_limits<int>::max();
+}
+
+Buffer* create_buffer_from_file(String filename, bool lazy)
 {
     filename = real_path(parse_filename(filename));
 
@@ -145,10 +207,58 @@ Buffer* create_buffer_from_file(String filename)
     if (S_ISDIR(st.st_mode))
         throw file_access_error(filename, "is a directory");
 
-    const char* data = (const char*)mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
-    auto unmap = on_scope_end([&]{ munmap((void*)data, st.st_size); });
+    if (st.st_size == 0)
+        return create_buffer_from_data({}, filename, Buffer::Flags::File,
+                                       { get_mtime(st), 0, 0, false });
+
+    // buffers opened lazily stay lazy when reloaded
+    if (Buffer* buffer = BufferManager::instance().get_buffer_ifp(filename))
+        lazy = lazy or (buffer->flags() & Buffer::Flags::Lazy);
+
+    if (is_too_big(st))
+        throw file_access_error(filename, "file is too big");
+
+    // the mapping is only used to find the lines
+    const size_t size = st.st_size;
+    const char* data = (const char*)mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (data == MAP_FAILED)
+        throw file_access_error(filename, strerror(errno));
+    auto unmap = on_scope_end([&]{ munmap((void*)data, size); });
+
+    // lines of lazy buffers are read from the file when first accessed.
+    // Reading them instead of keeping the mapping makes a file truncated
+    // in the meantime an error instead of a crash.
+    LineList::LazyReader reader;
+    if (lazy)
+    {
+        int lazy_fd = fcntl(fd, F_DUPFD_CLOEXEC, 0);
+        if (lazy_fd == -1)
+            throw file_access_error(filename, strerror(errno));
+        std::shared_ptr<const int> file{new int{lazy_fd}, [](const int* fd) {
+            close(*fd);
+            delete fd;
+        }};
+        reader = [file, filename](size_t offset, size_t length, char* buffer) {
+            while (length != 0)
+            {
+                ssize_t count = pread(*file, buffer, length, offset);
+                if (count < 0 and errno == EINTR)
+                    continue;
+                if (count <= 0)
+                    throw file_access_error(filename, count == 0 ? "file was truncated"
+                                                                 : strerror(errno));
+                buffer += count;
+                offset += count;
+                length -= count;
+            }
+        };
+    }
 
-    return create_buffer_from_data({data, data + st.st_size}, filename, Buffer::Flags::File, st.st_mtime);
+    // hashing the data is left until the file is touched, not to read it
+    // all when lazy
+    const FsStatus status{ get_mtime(st), (int)size, 0, false };
+    return create_buffer_from_data({data, data + size}, filename, Buffer::Flags::File,
+                                   status, std::move(reader));
 }
 
 static void write(int fd, StringView data)
@@ -159,55 +269,384 @@ static void write(int fd, StringView data)
     while (count)
     {
         ssize_t written = ::write(fd, ptr, count);
-        ptr += written;
-        count -= written;
-
         if (written == -1)
+        {
+            if (errno == EINTR)
+                continue;
             throw file_access_error("fd: " + to_string(fd), strerror(errno));
+        }
+        ptr += written;
+        count -= written;
     }
 }
 
-void write_buffer_to_fd(Buffer& buffer, int fd)
+// Accumulates written data so that it reaches the fd in big chunks,
+// hashing it on the way. With an fd of -1, the data is only hashed.
+class BufferedWriter
 {
-    const String& eolformat = buffer.options()["eolformat"].get<String>();
-    StringView eoldata;
-    if (eolformat == "crlf")
-        eoldata = "\r\n";
-    else
-        eoldata = "\n";
+public:
+    BufferedWriter(int fd) : m_fd(fd) {}
+
+    void write(StringView data)
+    {
+        const char* ptr = data.data();
+        int len = (int)data.length();
+        while (len > 0)
+        {
+            const int count = std::min(len, buffer_size - m_size);
+            memcpy(m_buffer + m_size, ptr, count);
+            m_size += count;
+            ptr += count;
+            len -= count;
+            if (m_size == buffer_size)
+                flush();
+        }
+    }
+
+    void flush()
+    {
+        if (m_size == 0)
+            return;
+        m_hash = hash_block(m_hash, m_buffer, m_size);
+        if (m_fd != -1)
+            Kakoune::write(m_fd, {m_buffer, m_buffer + m_size});
+        m_written += m_size;
+        m_size = 0;
+    }
+
+    // status of the written data, without timestamp
+    FsStatus status() const { return { InvalidTime, (int)m_written, m_hash, true }; }
+
+private:
+    static constexpr int buffer_size = hash_block_size;
+    int m_fd;
+    int m_size = 0;
+    size_t m_written = 0;
+    size_t m_hash = 0;
+    char m_buffer[buffer_size];
+};
 
-    if (buffer.options()["BOM"].get<String>() == "utf-8")
-        ::write(fd, "\xEF\xBB\xBF", 3);
+// how the buffer content should be written to a file
+struct WriteFormat
+{
+    WriteFormat(const Buffer& buffer)
+        : crlf{buffer.options()["eolformat"].get<String>() == "crlf"},
+          bom{buffer.options()["BOM"].get<String>() == "utf-8"} {}
+
+    bool crlf;
+    bool bom;
+};
+
+// calls write(data) with the content of lines, a Buffer or a snapshot of
+// its lines, as it should be written to a file
+template<typename Lines, typename Func>
+static void write_lines_content(const Lines& lines, LineCount line_count,
+                                WriteFormat format, Func write)
+{
+    const bool crlf = format.crlf;
+    if (format.bom)
+        write("\xEF\xBB\xBF");
 
-    for (LineCount i = 0; i < buffer.line_count(); ++i)
+    for (LineCount i = 0; i < line_count; ++i)
     {
         // end of lines are written according to eolformat but always
         // stored as \n
-        StringView linedata = buffer[i];
-        write(fd, linedata.substr(0, linedata.length()-1));
-        write(fd, eoldata);
+        StringView linedata = lines[i];
+        if (crlf)
+        {
+            write(linedata.substr(0, linedata.length()-1));
+            write("\r\n");
+        }
+        else
+            write(linedata);
     }
 }
 
-void write_buffer_to_file(Buffer& buffer, StringView filename)
+template<typename Lines>
+static FsStatus write_lines_data(const Lines& lines, LineCount line_count,
+                                 WriteFormat format, int fd)
 {
-    buffer.run_hook_in_own_context("BufWritePre", buffer.name());
+    BufferedWriter writer{fd};
+    write_lines_content(lines, line_count, format,
+                        [&](StringView data) { writer.write(data); });
+    writer.flush();
+    return writer.status();
+}
 
-    int fd = open(parse_filename(filename).c_str(),
-                  O_CREAT | O_WRONLY | O_TRUNC, 0644);
+static FsStatus write_buffer_data(Buffer& buffer, int fd)
+{
+    return write_lines_data(buffer, buffer.line_count(), WriteFormat{buffer}, fd);
+}
+
+size_t write_buffer_to_fd(Buffer& buffer, int fd)
+{
+    return (int)write_buffer_data(buffer, fd).file_size;
+}
+
+// write to a temporary file in the same directory, and rename it over
+// filename once safely on disk, so that filename always has either its
+// previous or its new content.
+template<typename Func>
+static FsStatus write_file_atomic(StringView filename, mode_t new_file_mode,
+                                  Func write_content)
+{
+    String path = real_path(filename);
+    String tmp_path = path + ".kak.XXXXXX";
+    int fd = mkstemp(&tmp_path[0_byte]);
     if (fd == -1)
         throw file_access_error(filename, strerror(errno));
-    auto close_fd = on_scope_end([fd]{ close(fd); });
+    fcntl(fd, F_SETFD, FD_CLOEXEC);
+
+    bool renamed = false;
+    auto cleanup = on_scope_end([&]{
+        close(fd);
+        if (not renamed)
+            unlink(tmp_path.c_str());
+    });
+
+    // mkstemp creates the file with 0600 permissions
+    struct stat st;
+    const mode_t mode = stat(path.c_str(), &st) == 0 ? st.st_mode & 07777
+                                                      : new_file_mode;
+    if (fchmod(fd, mode) != 0)
+        throw file_access_error(filename, strerror(errno));
+
+    const FsStatus status = write_content(fd);
+
+    if (fsync(fd) != 0 or rename(tmp_path.c_str(), path.c_str()) != 0)
+        throw file_access_error(filename, strerror(errno));
+    renamed = true;
+    return status;
+}
+
+// mode of the files we create, the umask cannot be read without being
+// modified, so this must not run concurrently with other threads.
+static mode_t get_new_file_mode()
+{
+    mode_t mask = umask(0);
+    umask(mask);
+    return 0644 & ~mask;
+}
+
+// write_content(fd) writes the data and returns its size and hash
+template<typename Func>
+static FsStatus write_file(StringView filename, bool atomic,
+                           mode_t new_file_mode, Func write_content)
+{
+    FsStatus status;
+    if (atomic)
+        status = write_file_atomic(filename, new_file_mode, write_content);
+    else
+    {
+        int fd = open(filename.zstr(), O_CREAT | O_WRONLY | O_TRUNC | O_CLOEXEC, 0644);
+        if (fd == -1)
+            throw file_access_error(filename, strerror(errno));
+        auto close_fd = on_scope_end([fd]{ close(fd); });
+
+        status = write_content(fd);
+    }
+    status.timestamp = get_fs_timestamp(filename);
+    return status;
+}
+
+static void write_debug_throughput(StringView filename, const FsStatus& status,
+                                   TimePoint start_time)
+{
+    const size_t written = (int)status.file_size;
+    using namespace std::chrono;
+    const auto us = std::max<long long>(1, duration_cast<microseconds>(Clock::now() - start_time).count());
+    write_debug("wrote " + to_string((int)written) + " bytes to '" + filename +
+                "' in " + to_string((int)(us / 1000)) + "ms (" +
+                to_string((int)(written / us)) + "MB/s)");
+}
+
+// A write running on its own thread, with a snapshot of the buffer
+// taken when it was started.
+struct BackgroundWrite
+{
+    String filename;
+    String hook_group;
+    Buffer* buffer; // null once the buffer is closed
+    std::shared_ptr<const BufferSnapshot> snapshot;
+    WriteFormat format;
+    bool atomic;
+    mode_t new_file_mode;
+    TimePoint start_time;
+
+    std::thread thread;
+    int notify_fds[2];
+    std::unique_ptr<FDWatcher> watcher;
+
+    // written by thread
+    FsStatus status;
+    String error;
+};
+
+
+// real_path keeps the names of files that do not exist and have no
+// directory part as they are, resolve them from the current directory
+static String absolute_path(StringView filename)
+{
+    if (not filename.empty() and filename[0] == '/')
+        return real_path(filename);
+    return real_path("./" + filename);
+}
+
+BackgroundWrites::BackgroundWrites() : new_file_mode{get_new_file_mode()} {}
+
+BackgroundWrites::~BackgroundWrites()
+{
+    wait_for_background_writes();
+}
 
-    write_buffer_to_fd(buffer, fd);
+bool background_write_in_progress(StringView filename)
+{
+    if (not BackgroundWrites::has_instance())
+        return false;
+    auto& background_writes = BackgroundWrites::instance().writes;
+    if (background_writes.empty())
+        return false;
+    const String path = absolute_path(filename);
+    return std::any_of(background_writes.begin(), background_writes.end(),
+                       [&](const std::unique_ptr<BackgroundWrite>& write)
+                       { return absolute_path(write->filename) == path; });
+}
+
+static void check_no_background_write(StringView filename)
+{
+    if (background_write_in_progress(filename))
+        throw runtime_error("a background write to '" + filename + "' is in progress");
+}
+
+// joins the thread of write, and updates its buffer. Hooks are not
+// ran when run_hooks is false.
+static void finish_background_write(std::unique_ptr<BackgroundWrite> write,
+                                    bool run_hooks)
+{
+    write->thread.join();
+    close(write->notify_fds[0]);
+    close(write->notify_fds[1]);
+
+    Buffer* buffer = write->buffer;
+    if (buffer)
+        buffer->hooks().remove_hooks(write->hook_group);
+
+    if (not write->error.empty())
+    {
+        write_debug("background write failed: " + write->error);
+        return;
+    }
+    write_debug_throughput(write->filename, write->status, write->start_time);
+
+    if (not buffer)
+        return;
+
+    if ((buffer->flags() & Buffer::Flags::File) and
+        real_path(write->filename) == real_path(buffer->name()))
+        buffer->notify_saved(write->status, write->snapshot->timestamp);
+
+    if (run_hooks)
+        buffer->run_hook_in_own_context("BufWritePost", buffer->name());
+}
+
+static void finish_background_write(BackgroundWrite* write_ptr)
+{
+    auto& background_writes = BackgroundWrites::instance().writes;
+    auto it = std::find_if(background_writes.begin(), background_writes.end(),
+                           [&](const std::unique_ptr<BackgroundWrite>& w)
+                           { return w.get() == write_ptr; });
+    kak_assert(it != background_writes.end());
+    std::unique_ptr<BackgroundWrite> write = std::move(*it);
+    background_writes.erase(it);
+    finish_background_write(std::move(write), true);
+}
+
+void write_buffer_to_file(Buffer& buffer, StringView filename, bool background)
+{
+    const String path = parse_filename(filename);
+    check_no_background_write(path);
+
+    buffer.run_hook_in_own_context("BufWritePre", buffer.name());
+
+    const auto start_time = Clock::now();
+    const bool atomic = buffer.options()["atomicwrite"].get<bool>();
+    // without an owner for the write, as when filtering, write synchronously.
+    // No write thread can be running then, so the umask can be read.
+    const mode_t new_file_mode = BackgroundWrites::has_instance() ?
+        BackgroundWrites::instance().new_file_mode : get_new_file_mode();
+    if (background and BackgroundWrites::has_instance())
+    {
+        static int write_id = 0;
+        std::unique_ptr<BackgroundWrite> write{new BackgroundWrite{
+            path, "background-write-" + to_string(++write_id), &buffer,
+            buffer.snapshot(), WriteFormat{buffer}, atomic, new_file_mode,
+            start_time}};
+        buffer.commit_undo_group();
+
+        if (pipe(write->notify_fds) != 0)
+            throw runtime_error("unable to create pipe: "_str + strerror(errno));
+        fcntl(write->notify_fds[0], F_SETFD, FD_CLOEXEC);
+        fcntl(write->notify_fds[1], F_SETFD, FD_CLOEXEC);
+
+        BackgroundWrite* write_ptr = write.get();
+        buffer.hooks().add_hook("BufClose", write->hook_group,
+            [write_ptr](const String&, const Context&) { write_ptr->buffer = nullptr; });
+        write->watcher.reset(new FDWatcher{write->notify_fds[0], [write_ptr](FDWatcher&) {
+            finish_background_write(write_ptr);
+        }});
+
+        write->thread = std::thread{[write_ptr] {
+            try
+            {
+                write_ptr->status = write_file(write_ptr->filename, write_ptr->atomic,
+                                           write_ptr->new_file_mode, [&](int fd) {
+                    const auto& lines = write_ptr->snapshot->lines;
+                    return write_lines_data(lines, lines.size(), write_ptr->format, fd);
+                });
+            }
+            catch (Kakoune::exception& err)
+            {
+                write_ptr->error = err.what();
+            }
+            catch (std::exception& err)
+            {
+                write_ptr->error = err.what();
+            }
+            catch (...)
+            {
+                write_ptr->error = "unknown error";
+            }
+            ::write(write_ptr->notify_fds[1], "", 1);
+        }};
+        BackgroundWrites::instance().writes.push_back(std::move(write));
+        return;
+    }
+
+    // the lines of a lazy buffer are read from its file, which is
+    // truncated when writing it in place
+    buffer.load_lines();
+    const FsStatus status = write_file(path, atomic, new_file_mode, [&](int fd) {
+        return write_buffer_data(buffer, fd);
+    });
+    write_debug_throughput(filename, status, start_time);
 
     if ((buffer.flags() & Buffer::Flags::File) and
         real_path(filename) == real_path(buffer.name()))
-        buffer.notify_saved();
+        buffer.notify_saved(status);
 
     buffer.run_hook_in_own_context("BufWritePost", buffer.name());
 }
 
+void wait_for_background_writes()
+{
+    if (not BackgroundWrites::has_instance())
+        return;
+    auto writes = std::move(BackgroundWrites::instance().writes);
+    BackgroundWrites::instance().writes.clear();
+    for (auto& write : writes)
+        finish_background_write(std::move(write), false);
+}
+
 String find_file(StringView filename, memoryview<String> paths)
 {
     struct stat buf;
@@ -383,12 +822,68 @@ std::vector<String> complete_command(StringView prefix, ByteCount cursor_pos)
     return res;
 }
 
-time_t get_fs_timestamp(StringView filename)
+timespec get_fs_timestamp(StringView filename)
 {
     struct stat st;
     if (stat(filename.zstr(), &st) != 0)
         return InvalidTime;
-    return st.st_mtime;
+    return get_mtime(st);
+}
+
+FsStatus get_fs_status(StringView filename)
+{
+    struct stat st;
+    if (stat(filename.zstr(), &st) != 0 or not S_ISREG(st.st_mode))
+        return InvalidFsStatus;
+    // no buffer can have the size of a file too big to be loaded
+    return { get_mtime(st), is_too_big(st) ? -1 : (int)st.st_size, 0, false };
+}
+
+// sets the hash of status, false if filename does not have its size anymore
+static bool hash_file(StringView filename, FsStatus& status)
+{
+    int fd = open(filename.zstr(), O_RDONLY);
+    if (fd == -1)
+        return false;
+    auto close_fd = on_scope_end([fd]{ close(fd); });
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 or st.st_size != (int)status.file_size)
+        return false;
+
+    const size_t size = st.st_size;
+    const char* data = size == 0 ? nullptr :
+        (const char*)mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (data == MAP_FAILED)
+        return false;
+    auto unmap = on_scope_end([&]{ if (data) munmap((void*)data, size); });
+    status.hash = hash_file_data({data, data + size});
+    status.has_hash = true;
+    return true;
+}
+
+bool is_file_touched(Buffer& buffer, StringView filename, FsStatus& status)
+{
+    FsStatus buffer_status = buffer.fs_status();
+    if (status.timestamp == InvalidTime or status.file_size != buffer_status.file_size)
+        return false;
+
+    if (not buffer_status.has_hash)
+    {
+        // the buffer content is the one loaded from the file, unless it was
+        // modified. The lines of a lazy buffer not read yet come from the
+        // file as it is now.
+        if (buffer.is_modified() or (buffer.flags() & Buffer::Flags::Lazy))
+            return false;
+        const FsStatus content = write_lines_data(buffer, buffer.line_count(),
+                                                  WriteFormat{buffer}, -1);
+        if (content.file_size != buffer_status.file_size)
+            return false;
+        buffer_status.hash = content.hash;
+        buffer_status.has_hash = true;
+        buffer.set_fs_status(buffer_status);
+    }
+    return hash_file(filename, status) and status.hash == buffer_status.hash;
 }
 
 }
@@ -3,6 +3,12 @@
 
 #include "string.hh"
 #include "exception.hh"
+#include "utils.hh"
+
+#include <memory>
+#include <vector>
+#include <sys/types.h>
+#include <time.h>
 
 namespace Kakoune
 {
@@ -23,6 +29,31 @@ struct file_not_found : file_access_error
 
 class Buffer;
 
+constexpr timespec InvalidTime = { -1, -1 };
+
+inline bool operator==(const timespec& lhs, const timespec& rhs)
+{
+    return lhs.tv_sec == rhs.tv_sec and lhs.tv_nsec == rhs.tv_nsec;
+}
+
+inline bool operator!=(const timespec& lhs, const timespec& rhs)
+{
+    return not (lhs == rhs);
+}
+
+// State of the file a buffer was last loaded from or saved to
+struct FsStatus
+{
+    timespec  timestamp;
+    ByteCount file_size;
+    // hash of the content, known when written, and only computed when
+    // needed for a loaded file, see is_file_touched
+    size_t    hash;
+    bool      has_hash;
+};
+
+constexpr FsStatus InvalidFsStatus = { InvalidTime, -1, 0, false };
+
 // parse ~/ and $env values in filename and returns the translated filename
 String parse_filename(StringView filename);
 String real_path(StringView filename);
@@ -31,14 +62,46 @@ String compact_path(StringView filename);
 String read_fd(int fd);
 String read_file(StringView filename);
 
-Buffer* create_buffer_from_file(String filename);
+// when lazy, the file stays mapped and lines are only read when accessed
+Buffer* create_buffer_from_file(String filename, bool lazy = false);
+
+// when background is true, the buffer content is written by another
+// thread, BufWritePost hooks run once it is done.
+void write_buffer_to_file(Buffer& buffer, StringView filename,
+                          bool background = false);
+// wait for pending background writes, without running their hooks
+void wait_for_background_writes();
+
+struct BackgroundWrite;
+
+// Owns the writes started by write -async, so that their threads are
+// joined before leaving the scope in which writes may be started.
+class BackgroundWrites : public Singleton<BackgroundWrites>
+{
+public:
+    BackgroundWrites();
+    ~BackgroundWrites();
+
+    // pending writes, in the order they were started
+    std::vector<std::unique_ptr<BackgroundWrite>> writes;
+    // mode of the files created by writes, read before any is started
+    const mode_t new_file_mode;
+};
 
-void write_buffer_to_file(Buffer& buffer, StringView filename);
-void write_buffer_to_fd(Buffer& buffer, int fd);
+// true while a background write to filename has not finished
+bool background_write_in_progress(StringView filename);
+// returns the number of bytes written
+size_t write_buffer_to_fd(Buffer& buffer, int fd);
 
 String find_file(StringView filename, memoryview<String> paths);
 
-time_t get_fs_timestamp(StringView filename);
+timespec get_fs_timestamp(StringView filename);
+// status of filename, without the hash of its content
+FsStatus get_fs_status(StringView filename);
+// true if filename, whose status is status, has the same size and hash as
+// when buffer was loaded from or written to it: it was only touched.
+// Computing the hash of a loaded buffer needs it not to be modified.
+bool is_file_touched(Buffer& buffer, StringView filename, FsStatus& status);
 
 std::vector<String> complete_filename(StringView prefix,
                                       const Regex& ignore_regex,
@@ -0,0 +1,147 @@
+#include "file_watcher.hh"
+
+#include "event_manager.hh"
+
+#include <algorithm>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <sys/inotify.h>
+#endif
+
+namespace Kakoune
+{
+
+// directory part of filename, including the trailing slash
+static StringView dirname(StringView filename)
+{
+    ByteCount len = filename.length();
+    while (len > 0 and filename[len-1] != '/')
+        --len;
+    return filename.substr(0, len);
+}
+
+FileWatcher::FileWatcher()
+{
+#ifdef __linux__
+    m_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (m_fd != -1)
+        m_watcher.reset(new FDWatcher{m_fd, [this](FDWatcher&) { read_events(); }});
+#endif
+}
+
+FileWatcher::~FileWatcher()
+{
+    m_watcher.reset();
+    if (m_fd != -1)
+        close(m_fd);
+}
+
+bool FileWatcher::may_have_changed(const String& filename)
+{
+#ifdef __linux__
+    if (m_fd == -1)
+        return true;
+
+    if (m_watched.count(filename) == 0)
+    {
+        String directory = dirname(filename).str();
+        if (directory.empty())
+            return true;
+
+        int wd = inotify_add_watch(m_fd, directory.c_str(),
+                                   IN_MODIFY | IN_ATTRIB | IN_CLOSE_WRITE |
+                                   IN_CREATE | IN_DELETE | IN_MOVED_TO);
+        if (wd == -1)
+            return true;
+
+        m_directories[wd] = std::move(directory);
+        m_watched.insert(filename);
+        // we do not know what happened before it was watched
+        m_changed.insert(filename);
+    }
+    return m_changed.count(filename) != 0;
+#else
+    return true;
+#endif
+}
+
+void FileWatcher::clear_changed(const String& filename)
+{
+    m_changed.erase(filename);
+}
+
+void FileWatcher::unwatch(const String& filename)
+{
+    m_changed.erase(filename);
+#ifdef __linux__
+    if (m_watched.erase(filename) == 0)
+        return;
+
+    const StringView directory = dirname(filename);
+    if (std::any_of(m_watched.begin(), m_watched.end(),
+                    [&](const String& file) { return dirname(file) == directory; }))
+        return;
+
+    auto it = std::find_if(m_directories.begin(), m_directories.end(),
+                           [&](const std::pair<const int, String>& dir)
+                           { return dir.second == directory; });
+    if (it != m_directories.end())
+    {
+        inotify_rm_watch(m_fd, it->first);
+        m_directories.erase(it);
+    }
+#endif
+}
+
+void FileWatcher::read_events()
+{
+#ifdef __linux__
+    alignas(inotify_event) char data[4096];
+    ssize_t len;
+    while ((len = read(m_fd, data, sizeof(data))) > 0)
+    {
+        for (char* ptr = data; ptr < data + len; )
+        {
+            const inotify_event& event = *reinterpret_cast<inotify_event*>(ptr);
+            ptr += sizeof(inotify_event) + event.len;
+
+            if (event.mask & IN_Q_OVERFLOW)
+            {
+                m_changed.insert(m_watched.begin(), m_watched.end());
+                continue;
+            }
+
+            auto it = m_directories.find(event.wd);
+            if (it == m_directories.end())
+                continue;
+
+            // the directory is gone, files in it will need to be watched again
+            if (event.mask & IN_IGNORED)
+            {
+                for (auto file = m_watched.begin(); file != m_watched.end(); )
+                {
+                    if (dirname(*file) == it->second)
+                    {
+                        m_changed.insert(*file);
+                        file = m_watched.erase(file);
+                    }
+                    else
+                        ++file;
+                }
+                m_directories.erase(it);
+                continue;
+            }
+
+            if (event.len == 0)
+                continue;
+
+            String filename = it->second + event.name;
+            if (m_watched.count(filename) != 0)
+                m_changed.insert(std::move(filename));
+        }
+    }
+#endif
+}
+
+}
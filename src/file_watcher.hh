@@ -0,0 +1,46 @@
+#ifndef file_watcher_hh_INCLUDED
+#define file_watcher_hh_INCLUDED
+
+#include "string.hh"
+#include "utils.hh"
+
+#include <memory>
+#include <unordered_map>
+#include <unordered_set>
+
+namespace Kakoune
+{
+
+class FDWatcher;
+
+// Watches the directories of files using inotify, so that only files
+// which might have been modified need to be checked. When inotify is not
+// available every file is considered possibly modified.
+class FileWatcher : public Singleton<FileWatcher>
+{
+public:
+    FileWatcher();
+    ~FileWatcher();
+
+    // returns false if filename was not modified since the last call to
+    // clear_changed, starts watching it if needed.
+    bool may_have_changed(const String& filename);
+    void clear_changed(const String& filename);
+    // stops watching filename, and its directory if no other file in it
+    // is watched
+    void unwatch(const String& filename);
+
+private:
+    void read_events();
+
+    int m_fd = -1;
+    std::unique_ptr<FDWatcher> m_watcher;
+    // watch descriptor to watched directory
+    std::unordered_map<int, String> m_directories;
+    std::unordered_set<String> m_watched;
+    std::unordered_set<String> m_changed;
+};
+
+}
+
+#endif // file_watcher_hh_INCLUDED
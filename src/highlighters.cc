@@ -10,6 +10,7 @@
 #include "option_types.hh"
 #include "parameters_parser.hh"
 #include "register_manager.hh"
+#include "regex_search.hh"
 #include "string.hh"
 #include "utf8.hh"
 #include "utf8_iterator.hh"
@@ -22,8 +23,6 @@ namespace Kakoune
 
 using namespace std::placeholders;
 
-using RegexIterator = boost::regex_iterator<BufferIterator>;
-
 template<typename T>
 void highlight_range(DisplayBuffer& display_buffer,
                      ByteCoord begin, ByteCoord end,
@@ -256,8 +255,10 @@ private:
         cache.m_timestamp = buffer.timestamp();
 
         cache.m_matches.clear();
-        RegexIterator re_it{buffer.iterator_at(cache.m_range.first),
-                            buffer.iterator_at(cache.m_range.second+1), m_regex};
+        const ByteCoord end = cache.m_range.second+1 < buffer.line_count() ?
+            ByteCoord{cache.m_range.second+1, 0} : buffer.end_coord();
+        RegexIterator re_it{SegmentIterator{buffer, cache.m_range.first},
+                            SegmentIterator{buffer, end}, m_regex};
         RegexIterator re_end;
         for (; re_it != re_end; ++re_it)
         {
@@ -423,7 +424,8 @@ void expand_tabulations(const Context& context, HighlightFlags flags, DisplayBuf
     {
         for (auto atom_it = line.begin(); atom_it != line.end(); ++atom_it)
         {
-            if (atom_it->type() != DisplayAtom::BufferRange)
+            if (atom_it->type() != DisplayAtom::BufferRange or
+                not buffer.line_info(atom_it->begin().line).has_tab)
                 continue;
 
             auto begin = buffer.iterator_at(atom_it->begin());
@@ -599,7 +601,8 @@ void expand_unprintable(const Context& context, HighlightFlags flags, DisplayBuf
     {
         for (auto atom_it = line.begin(); atom_it != line.end(); ++atom_it)
         {
-            if (atom_it->type() == DisplayAtom::BufferRange)
+            if (atom_it->type() == DisplayAtom::BufferRange and
+                buffer.line_info(atom_it->begin().line).has_unprintable)
             {
                 for (auto it  = buffer.iterator_at(atom_it->begin()),
                           end = buffer.iterator_at(atom_it->end()); it < end;)
@@ -974,7 +977,7 @@ private:
         if (cache.timestamp == buf_timestamp)
             return cache.regions;
 
-        if (cache.timestamp == 0)
+        if (cache.timestamp == 0 or not buffer.changes_available_since(cache.timestamp))
         {
             cache.matches.resize(m_regions.size());
             for (size_t i = 0; i < m_regions.size(); ++i)
@@ -3,11 +3,13 @@
 #include "buffer_manager.hh"
 #include "buffer_utils.hh"
 #include "client.hh"
+#include "client_manager.hh"
 #include "event_manager.hh"
 #include "face_registry.hh"
 #include "insert_completer.hh"
 #include "normal.hh"
 #include "register_manager.hh"
+#include "search_index.hh"
 #include "user_interface.hh"
 #include "utf8.hh"
 #include "window.hh"
@@ -48,6 +50,8 @@ namespace InputModes
 
 static constexpr std::chrono::milliseconds idle_timeout{100};
 static constexpr std::chrono::milliseconds fs_check_timeout{500};
+// packing buffer lines copies them, do it only after a longer idle period
+static constexpr std::chrono::seconds pack_timeout{30};
 
 class Normal : public InputMode
 {
@@ -57,6 +61,17 @@ public:
           m_idle_timer{Clock::now() + idle_timeout, [this](Timer& timer) {
               context().hooks().run_hook("NormalIdle", "", context());
           }},
+          m_pack_timer{Clock::now() + pack_timeout, [](Timer& timer) {
+              // the lines of displayed buffers are accessed on each redraw
+              for (auto& buffer : BufferManager::instance())
+              {
+                  if (not ClientManager::instance().is_displayed(*buffer))
+                  {
+                      buffer->pack_lines();
+                      SearchIndex::drop(*buffer);
+                  }
+              }
+          }},
           m_fs_check_timer{Clock::now() + fs_check_timeout, [this](Timer& timer) {
               if (not context().has_client())
                   return;
@@ -126,11 +141,19 @@ public:
         }
         context().hooks().run_hook("NormalKey", key_to_str(key), context());
         m_idle_timer.set_next_date(Clock::now() + idle_timeout);
+        m_pack_timer.set_next_date(Clock::now() + pack_timeout);
     }
 
     DisplayLine mode_line() const override
     {
         AtomList atoms = { { to_string(context().selections().size()) + " sel", Face(Colors::Blue) } };
+        if (auto index = current_search_index(context()))
+        {
+            const size_t count = index->matches().size();
+            const size_t current = index->count_until(context().selections().main().min());
+            atoms.push_back({ "; match=", Face(Colors::Yellow) });
+            atoms.push_back({ to_string(current) + "/" + to_string(count), Face(Colors::Green) });
+        }
         if (m_count != 0)
         {
             atoms.push_back({ "; param=", Face(Colors::Yellow) });
@@ -145,6 +168,7 @@ private:
     int m_count = 0;
     bool m_hooks_disabled = false;
     Timer m_idle_timer;
+    Timer m_pack_timer;
     Timer m_fs_check_timer;
 };
 
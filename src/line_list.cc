@@ -0,0 +1,742 @@
+#include "line_list.hh"
+
+#include "utf8.hh"
+
+#include <algorithm>
+#include <atomic>
+#include <wctype.h>
+
+namespace Kakoune
+{
+
+static ByteCount lines_byte_count(const String* begin, const String* end)
+{
+    ByteCount res = 0;
+    for (auto it = begin; it != end; ++it)
+        res += it->length();
+    return res;
+}
+
+void LineList::assign(std::vector<String> lines)
+{
+    clear();
+    replace_blocks(0, 0, std::move(lines));
+}
+
+void LineList::assign(StringView data, const std::vector<const char*>& line_starts,
+                      LazyReader reader)
+{
+    clear();
+    const size_t count = line_starts.size();
+    if (count == 0)
+        return;
+
+    // size of the line once loaded, which always ends with a single \n
+    auto line_length = [&](size_t i) -> ByteCount {
+        const char* begin = line_starts[i];
+        const char* end = i + 1 < count ? line_starts[i+1] : data.end();
+        const ByteCount length = (int)(end - begin);
+        if (end[-1] != '\n' and end[-1] != '\r')
+            return length + 1;
+        if (end - begin >= 2 and end[-2] == '\r' and end[-1] == '\n')
+            return length - 1;
+        return length;
+    };
+
+    const size_t block_count = (count + target_block_size - 1) / target_block_size;
+    m_blocks.resize(block_count);
+    size_t index = 0;
+    for (size_t i = 0; i < block_count; ++i)
+    {
+        const size_t size = count / block_count + (i < count % block_count ? 1 : 0);
+        Block& block = m_blocks[i];
+        if (not reader)
+        {
+            for (size_t line = index; line != index + size; ++line)
+                block.bytes += line_length(line);
+            auto packed = std::make_shared<PackedLines>();
+            packed->data.reset(new char[(int)block.bytes]);
+            packed->ends.reserve(size);
+            char* pos = packed->data.get();
+            for (size_t end = index + size; index != end; ++index)
+            {
+                const ByteCount length = line_length(index);
+                std::copy(line_starts[index], line_starts[index] + (int)length - 1, pos);
+                pos[(int)length - 1] = '\n';
+                pos += (int)length;
+                packed->ends.push_back((uint32_t)(pos - packed->data.get()));
+            }
+            block.packed = std::move(packed);
+            continue;
+        }
+
+        const char* block_begin = line_starts[index];
+        const char* block_end = index + size < count ? line_starts[index + size] : data.end();
+        block.lazy_offset = block_begin - data.begin();
+        block.lazy_length = block_end - block_begin;
+        block.lazy_starts.reserve(size);
+        for (size_t end = index + size; index != end; ++index)
+        {
+            block.lazy_starts.push_back((uint32_t)(line_starts[index] - block_begin));
+            block.bytes += line_length(index);
+        }
+    }
+    if (reader)
+    {
+        m_lazy_reader = std::move(reader);
+        m_lazy_blocks = block_count;
+    }
+    update_block_begins(0);
+
+    // keep the last line directly accessible
+    load(m_blocks.back());
+}
+
+void LineList::clear()
+{
+    m_blocks.clear();
+    m_lazy_blocks = 0;
+    m_lazy_reader = nullptr;
+    invalidate_byte_begins(0);
+    update_block_begins(0);
+}
+
+void LineList::load(const Block& block) const
+{
+    block.last_access = ++m_access_clock;
+
+    if (block.packed)
+    {
+        auto lines = std::make_shared<std::vector<String>>();
+        lines->reserve(block.packed->ends.size());
+        const char* data = block.packed->data.get();
+        uint32_t begin = 0;
+        for (auto end : block.packed->ends)
+        {
+            lines->emplace_back(data + begin, data + end);
+            begin = end;
+        }
+        block.shared_lines = std::move(lines);
+        block.packed.reset();
+        return;
+    }
+
+    if (block.lazy_starts.empty())
+        return;
+
+    // the block is left untouched if its data cannot be read
+    std::unique_ptr<char[]> data{new char[block.lazy_length]};
+    m_lazy_reader(block.lazy_offset, block.lazy_length, data.get());
+    const char* data_end = data.get() + block.lazy_length;
+
+    auto lines = std::make_shared<std::vector<String>>();
+    lines->reserve(block.lazy_starts.size());
+    for (auto offset : block.lazy_starts)
+    {
+        const char* begin = data.get() + offset;
+        const char* end = std::find_if(begin, data_end,
+                                       [](char c) { return c == '\n' or c == '\r'; });
+        String line;
+        line.reserve((int)(end - begin) + 1);
+        line.append(begin, end);
+        line += '\n';
+        lines->push_back(std::move(line));
+    }
+    block.shared_lines = std::move(lines);
+    block.lazy_starts = std::vector<uint32_t>{};
+
+    // everything is loaded, we can release the data source
+    if (--m_lazy_blocks == 0)
+        m_lazy_reader = nullptr;
+}
+
+void LineList::load_all() const
+{
+    for (auto& block : m_blocks)
+    {
+        if (not is_lazy())
+            return;
+        if (not block.lazy_starts.empty())
+            load(block);
+    }
+}
+
+void LineList::pack()
+{
+    // the last block is never packed, see back()
+    for (size_t i = 0; i + 1 < m_blocks.size(); ++i)
+    {
+        Block& block = m_blocks[i];
+        if (block.lines().empty() or m_access_clock - block.last_access < recent_access_count)
+            continue;
+
+        auto packed = std::make_shared<PackedLines>();
+        packed->data.reset(new char[(int)block.bytes]);
+        packed->ends.reserve(block.lines().size());
+        char* pos = packed->data.get();
+        for (auto& line : block.lines())
+        {
+            pos = std::copy(line.begin(), line.end(), pos);
+            packed->ends.push_back((uint32_t)(pos - packed->data.get()));
+        }
+        block.packed = std::move(packed);
+        // snapshots sharing the lines keep them alive
+        block.shared_lines.reset();
+    }
+    m_cache_size = 0;
+}
+
+size_t LineList::memory() const
+{
+    size_t res = m_blocks.capacity() * sizeof(Block);
+    for (auto& block : m_blocks)
+    {
+        res += block.lines().capacity() * sizeof(String) +
+               block.lazy_starts.capacity() * sizeof(uint32_t) +
+               block.infos.capacity() * sizeof(LineInfo);
+        if (block.packed)
+            res += (int)block.bytes + block.packed->ends.capacity() * sizeof(uint32_t);
+        for (auto& line : block.lines())
+        {
+            // short strings are stored inline
+            const char* data = line.data();
+            if (data < (const char*)&line or data >= (const char*)(&line + 1))
+                res += line.capacity() + 1;
+        }
+    }
+    return res;
+}
+
+const std::vector<String>& LineList::block_lines(size_t index) const
+{
+    load(m_blocks[index]);
+    return m_blocks[index].lines();
+}
+
+std::vector<String>& LineList::mutable_lines(const Block& block) const
+{
+    if (not block.shared_lines)
+        block.shared_lines = std::make_shared<std::vector<String>>();
+    else if (block.shared_lines.use_count() > 1)
+    {
+        block.shared_lines = std::make_shared<std::vector<String>>(*block.shared_lines);
+        m_cache_size = 0;
+    }
+    else // synchronize with snapshots released by other threads
+        std::atomic_thread_fence(std::memory_order_acquire);
+    return *block.shared_lines;
+}
+
+LineList::Snapshot LineList::snapshot() const
+{
+    Snapshot snapshot;
+    snapshot.m_blocks.reserve(m_blocks.size());
+    for (auto& block : m_blocks)
+    {
+        if (not block.lazy_starts.empty())
+            load(block);
+        snapshot.m_blocks.push_back({block.begin, block.shared_lines, block.packed});
+    }
+    snapshot.m_line_count = m_line_count;
+    snapshot.m_byte_count = byte_count();
+    return snapshot;
+}
+
+StringView LineList::Snapshot::operator[](LineCount line) const
+{
+    kak_assert(line >= 0 and line < m_line_count);
+    auto it = std::upper_bound(m_blocks.begin(), m_blocks.end(), line,
+                               [](LineCount l, const Block& block)
+                               { return l < block.begin; });
+    kak_assert(it != m_blocks.begin());
+    return line_in_block(*(it-1), line);
+}
+
+StringView LineList::Snapshot::line(LineCount line, int& block) const
+{
+    kak_assert(line >= 0 and line < m_line_count);
+    auto in_block = [&](int index) {
+        return index >= 0 and index < (int)m_blocks.size() and m_blocks[index].begin <= line and
+               (index + 1 == (int)m_blocks.size() or line < m_blocks[index+1].begin);
+    };
+    // iterating over the lines reads the same block or the next one
+    if (not in_block(block))
+    {
+        if (in_block(block + 1))
+            ++block;
+        else if (in_block(block - 1))
+            --block;
+        else
+            block = (int)(std::upper_bound(m_blocks.begin(), m_blocks.end(), line,
+                                           [](LineCount l, const Block& block)
+                                           { return l < block.begin; }) - m_blocks.begin()) - 1;
+    }
+    return line_in_block(m_blocks[block], line);
+}
+
+StringView LineList::Snapshot::line_in_block(const Block& block, LineCount line) const
+{
+    const int index = (int)(line - block.begin);
+    if (not block.packed)
+        return (*block.lines)[index];
+
+    const char* data = block.packed->data.get();
+    return { data + (index == 0 ? 0 : block.packed->ends[index-1]),
+             data + block.packed->ends[index] };
+}
+
+void LineList::insert(LineCount pos, std::vector<String> lines)
+{
+    kak_assert(pos >= 0 and pos <= m_line_count);
+    if (lines.empty())
+        return;
+
+    if (m_blocks.empty())
+        return replace_blocks(0, 0, std::move(lines));
+
+    const size_t block_index = pos == m_line_count ? m_blocks.size() - 1
+                                                   : find_block(pos);
+    Block& block = m_blocks[block_index];
+    load(block);
+    auto& block_lines = mutable_lines(block);
+    const int offset = (int)(pos - block.begin);
+
+    if (block_lines.size() + lines.size() <= max_block_size)
+    {
+        block.bytes += lines_byte_count(lines.data(), lines.data() + lines.size());
+        invalidate_byte_begins(block_index + 1);
+        if (not block.infos.empty())
+            block.infos.insert(block.infos.begin() + offset, lines.size(), LineInfo{});
+        block_lines.insert(block_lines.begin() + offset,
+                           std::make_move_iterator(lines.begin()),
+                           std::make_move_iterator(lines.end()));
+        return update_block_begins(block_index);
+    }
+
+    std::vector<String> content;
+    content.reserve(block_lines.size() + lines.size());
+    std::move(block_lines.begin(), block_lines.begin() + offset,
+              std::back_inserter(content));
+    std::move(lines.begin(), lines.end(), std::back_inserter(content));
+    std::move(block_lines.begin() + offset, block_lines.end(),
+              std::back_inserter(content));
+    replace_blocks(block_index, block_index + 1, std::move(content));
+}
+
+void LineList::push_back(String line)
+{
+    if (not m_blocks.empty() and m_blocks.back().lines().size() < max_block_size)
+    {
+        m_blocks.back().bytes += line.length();
+        mutable_lines(m_blocks.back()).push_back(std::move(line));
+        if (not m_blocks.back().infos.empty())
+            m_blocks.back().infos.emplace_back();
+        ++m_line_count;
+        m_cache_size = 0;
+        return;
+    }
+    std::vector<String> lines;
+    lines.push_back(std::move(line));
+    insert(m_line_count, std::move(lines));
+}
+
+void LineList::erase(LineCount first, LineCount last)
+{
+    kak_assert(first >= 0 and first <= last and last <= m_line_count);
+    if (first == last)
+        return;
+
+    size_t first_block = find_block(first);
+    size_t last_block = find_block(last - 1);
+    Block& fblock = m_blocks[first_block];
+    Block& lblock = m_blocks[last_block];
+    load(fblock);
+    load(lblock);
+    auto& flines = mutable_lines(fblock);
+    auto& llines = mutable_lines(lblock);
+
+    const int first_offset = (int)(first - fblock.begin);
+    const int last_offset = (int)(last - lblock.begin);
+
+    if (first_block == last_block and
+        flines.size() - (last_offset - first_offset) >= min_block_size)
+    {
+        fblock.bytes -= lines_byte_count(flines.data() + first_offset,
+                                         flines.data() + last_offset);
+        invalidate_byte_begins(first_block + 1);
+        flines.erase(flines.begin() + first_offset, flines.begin() + last_offset);
+        if (not fblock.infos.empty())
+            fblock.infos.erase(fblock.infos.begin() + first_offset,
+                               fblock.infos.begin() + last_offset);
+        return update_block_begins(first_block);
+    }
+
+    std::vector<String> remaining;
+    std::move(flines.begin(), flines.begin() + first_offset,
+              std::back_inserter(remaining));
+    std::move(llines.begin() + last_offset, llines.end(),
+              std::back_inserter(remaining));
+
+    // avoid leaving undersized blocks around by merging with a neighbour
+    if (remaining.size() < min_block_size)
+    {
+        if (last_block + 1 < m_blocks.size())
+        {
+            load(m_blocks[++last_block]);
+            auto& next = mutable_lines(m_blocks[last_block]);
+            std::move(next.begin(), next.end(), std::back_inserter(remaining));
+        }
+        else if (first_block > 0)
+        {
+            load(m_blocks[--first_block]);
+            auto& prev = mutable_lines(m_blocks[first_block]);
+            std::move(remaining.begin(), remaining.end(), std::back_inserter(prev));
+            remaining = std::move(prev);
+        }
+    }
+    replace_blocks(first_block, last_block + 1, std::move(remaining));
+}
+
+void LineList::replace(const std::vector<Replacement>& replacements, std::vector<String> lines)
+{
+    if (replacements.empty())
+        return;
+
+    // when no replacement changes the number of lines, such as when typing
+    // with several cursors, the blocks are kept and only their lines set
+    if (std::all_of(replacements.begin(), replacements.end(),
+                    [](const Replacement& r) { return (int)r.count == (int)(r.last - r.first); }))
+    {
+        auto replacement_lines = lines.begin();
+        for (auto& replacement : replacements)
+        {
+            for (LineCount line = replacement.first; line < replacement.last; ++line)
+                set(line, std::move(*replacement_lines++));
+        }
+        return;
+    }
+
+    // untouched blocks are kept as is, lines of touched blocks are gathered
+    // in content, which is split in new blocks once big enough.
+    std::vector<Block> blocks;
+    std::vector<String> content;
+    auto flush = [&] {
+        const size_t count = content.size();
+        if (count <= max_block_size)
+        {
+            blocks.emplace_back();
+            blocks.back().bytes = lines_byte_count(content.data(), content.data() + count);
+            blocks.back().shared_lines = std::make_shared<std::vector<String>>(std::move(content));
+            content = std::vector<String>{};
+            content.reserve(max_block_size);
+            return;
+        }
+        const size_t block_count = (count + target_block_size - 1) / target_block_size;
+        auto it = content.begin();
+        for (size_t i = 0; i < block_count; ++i)
+        {
+            const size_t size = count / block_count + (i < count % block_count ? 1 : 0);
+            blocks.emplace_back();
+            Block& block = blocks.back();
+            block.bytes = lines_byte_count(&*it, &*it + size);
+            block.shared_lines = std::make_shared<std::vector<String>>(
+                std::make_move_iterator(it), std::make_move_iterator(it + size));
+            it += size;
+        }
+        content.clear();
+    };
+    content.reserve(max_block_size);
+
+    auto replacement = replacements.begin();
+    auto replacement_lines = lines.begin();
+    for (size_t i = 0; i < m_blocks.size(); ++i)
+    {
+        Block& block = m_blocks[i];
+        const LineCount block_end = block.begin + (int)block.size();
+        const bool touched = replacement != replacements.end() and
+                             replacement->first < block_end;
+        // do not leave undersized blocks behind touched ones
+        if (not touched and (content.empty() or content.size() >= min_block_size))
+        {
+            if (not content.empty())
+                flush();
+            blocks.push_back(std::move(block));
+            continue;
+        }
+
+        load(block);
+
+        // replacements keeping the number of lines of the block are done in place
+        auto next = replacement;
+        int line_delta = 0;
+        for (; next != replacements.end() and next->last <= block_end; ++next)
+            line_delta += (int)next->count - (int)(next->last - next->first);
+        if (content.empty() and line_delta == 0 and replacement->first >= block.begin and
+            (next == replacements.end() or next->first >= block_end))
+        {
+            for (; replacement != next; ++replacement)
+            {
+                for (size_t k = 0; k < replacement->count; ++k)
+                {
+                    const int index = (int)(replacement->first - block.begin) + k;
+                    String& line = mutable_lines(block)[index];
+                    block.bytes += replacement_lines->length() - line.length();
+                    line = std::move(*replacement_lines++);
+                    if (not block.infos.empty())
+                        block.infos[index] = LineInfo{};
+                }
+            }
+            blocks.push_back(std::move(block));
+            continue;
+        }
+
+        for (LineCount line = block.begin; line < block_end; ++line)
+        {
+            while (replacement != replacements.end() and replacement->last <= line)
+                ++replacement;
+            if (replacement == replacements.end() or line < replacement->first)
+                content.push_back(std::move(mutable_lines(block)[(int)(line - block.begin)]));
+            else if (line == replacement->first)
+            {
+                std::move(replacement_lines, replacement_lines + replacement->count,
+                          std::back_inserter(content));
+                replacement_lines += replacement->count;
+            }
+            // flushing at target_block_size would leave a few lines behind
+            // each block, gathering the following untouched blocks as well
+            if (content.size() >= max_block_size)
+                flush();
+        }
+    }
+    kak_assert(replacement == replacements.end() or
+               (replacement + 1 == replacements.end() and replacement->last == m_line_count));
+    if (not content.empty())
+        flush();
+
+    m_blocks = std::move(blocks);
+    invalidate_byte_begins(0);
+    update_block_begins(0);
+}
+
+size_t LineList::find_block(LineCount line) const
+{
+    kak_assert(line >= 0 and line < m_line_count);
+    auto it = std::upper_bound(m_blocks.begin(), m_blocks.end(), line,
+                               [](LineCount l, const Block& block)
+                               { return l < block.begin; });
+    kak_assert(it != m_blocks.begin());
+    return it - m_blocks.begin() - 1;
+}
+
+const String& LineList::lookup(LineCount line) const
+{
+    auto& block = m_blocks[find_block(line)];
+    load(block);
+    m_cache_lines = block.lines().data();
+    m_cache_begin = block.begin;
+    m_cache_size = block.lines().size();
+    return m_cache_lines[(int)(line - m_cache_begin)];
+}
+
+// replace blocks in [first, last) with new blocks holding lines
+void LineList::replace_blocks(size_t first, size_t last, std::vector<String> lines)
+{
+    const size_t count = lines.size();
+    const size_t block_count = (count + target_block_size - 1) / target_block_size;
+
+    std::vector<Block> new_blocks(block_count);
+    auto it = lines.begin();
+    for (size_t i = 0; i < block_count; ++i)
+    {
+        // distribute lines evenly so that no block ends up undersized
+        const size_t size = count / block_count + (i < count % block_count ? 1 : 0);
+        new_blocks[i].bytes = lines_byte_count(&*it, &*it + size);
+        new_blocks[i].shared_lines = std::make_shared<std::vector<String>>(
+            std::make_move_iterator(it), std::make_move_iterator(it + size));
+        it += size;
+    }
+    invalidate_byte_begins(first);
+
+    for (size_t i = first; i < last; ++i)
+    {
+        if (not m_blocks[i].lazy_starts.empty() and --m_lazy_blocks == 0)
+            m_lazy_reader = nullptr;
+    }
+
+    auto pos = m_blocks.erase(m_blocks.begin() + first, m_blocks.begin() + last);
+    m_blocks.insert(pos, std::make_move_iterator(new_blocks.begin()),
+                    std::make_move_iterator(new_blocks.end()));
+    update_block_begins(first);
+}
+
+void LineList::update_block_begins(size_t first)
+{
+    LineCount begin = first == 0 ? 0 : m_blocks[first-1].begin +
+                                       (int)m_blocks[first-1].size();
+    for (size_t i = first; i < m_blocks.size(); ++i)
+    {
+        m_blocks[i].begin = begin;
+        begin += (int)m_blocks[i].size();
+    }
+    m_line_count = begin;
+    m_cache_size = 0;
+}
+
+void LineList::set(LineCount line, String content)
+{
+    const size_t block_index = find_block(line);
+    Block& block = m_blocks[block_index];
+    load(block);
+    const int index = (int)(line - block.begin);
+    String& target = mutable_lines(block)[index];
+    block.bytes += content.length() - target.length();
+    invalidate_byte_begins(block_index + 1);
+    target = std::move(content);
+    if (not block.infos.empty())
+        block.infos[index] = LineInfo{};
+}
+
+void LineList::replace_in_line(LineCount line, ByteCount column, ByteCount length,
+                               StringView content)
+{
+    kak_assert(std::find(content.begin(), content.end(), '\n') == content.end());
+    const size_t block_index = find_block(line);
+    Block& block = m_blocks[block_index];
+    load(block);
+    const int index = (int)(line - block.begin);
+    String& target = mutable_lines(block)[index];
+    kak_assert(column + length < target.length());
+    // the line keeps its capacity, growing it geometrically, so that
+    // repeated edits do not reallocate it
+    target.replace((int)column, (int)length, content.data(), (int)content.length());
+    block.bytes += content.length() - length;
+    invalidate_byte_begins(block_index + 1);
+    if (not block.infos.empty())
+        block.infos[index] = LineInfo{};
+}
+
+static LineList::LineInfo compute_line_info(const String& line)
+{
+    LineList::LineInfo info;
+    info.char_count = 0;
+    info.ascii = true;
+    info.has_tab = false;
+    info.has_unprintable = false;
+    for (unsigned char c : line)
+    {
+        if (utf8::is_character_start(c))
+            ++info.char_count;
+        if (c >= 0x80)
+            info.ascii = false;
+        else if (c == '\t')
+            info.has_tab = true;
+        if ((c < 0x20 and c != '\n') or c == 0x7F)
+            info.has_unprintable = true;
+    }
+    if (info.ascii or info.has_unprintable)
+        return info;
+
+    for (auto it = line.begin(), end = line.end(); it != end; it = utf8::next(it, end))
+    {
+        const Codepoint cp = utf8::codepoint<utf8::InvalidPolicy::Pass>(it, end);
+        if (cp >= 0x80 and not iswprint(cp))
+        {
+            info.has_unprintable = true;
+            break;
+        }
+    }
+    return info;
+}
+
+const LineList::LineInfo& LineList::info(LineCount line) const
+{
+    const Block& block = m_blocks[find_block(line)];
+    load(block);
+    if (block.infos.empty())
+        block.infos.resize(block.lines().size());
+
+    const int index = (int)(line - block.begin);
+    LineInfo& info = block.infos[index];
+    if (info.char_count < 0)
+        info = compute_line_info(block.lines()[index]);
+    return info;
+}
+
+void LineList::invalidate_byte_begins(size_t first)
+{
+    m_valid_byte_begins = std::min(m_valid_byte_begins, first);
+}
+
+void LineList::update_byte_begins(size_t last) const
+{
+    for (size_t i = m_valid_byte_begins; i <= last; ++i)
+        m_blocks[i].byte_begin = i == 0 ? 0 : m_blocks[i-1].byte_begin + m_blocks[i-1].bytes;
+    m_valid_byte_begins = std::max(m_valid_byte_begins, last + 1);
+}
+
+ByteCount LineList::byte_count() const
+{
+    if (m_blocks.empty())
+        return 0;
+    update_byte_begins(m_blocks.size() - 1);
+    return m_blocks.back().byte_begin + m_blocks.back().bytes;
+}
+
+ByteCount LineList::line_offset(LineCount line) const
+{
+    kak_assert(line >= 0 and line <= m_line_count);
+    if (line == m_line_count)
+        return byte_count();
+
+    const size_t block_index = find_block(line);
+    update_byte_begins(block_index);
+    const Block& block = m_blocks[block_index];
+    load(block);
+    return block.byte_begin +
+           lines_byte_count(block.lines().data(),
+                            block.lines().data() + (int)(line - block.begin));
+}
+
+LineCount LineList::line_at_offset(ByteCount offset) const
+{
+    kak_assert(offset >= 0 and offset < byte_count());
+    update_byte_begins(m_blocks.size() - 1);
+    auto it = std::upper_bound(m_blocks.begin(), m_blocks.end(), offset,
+                               [](ByteCount o, const Block& block)
+                               { return o < block.byte_begin; });
+    kak_assert(it != m_blocks.begin());
+    const Block& block = *(it-1);
+    load(block);
+    offset -= block.byte_begin;
+    LineCount line = block.begin;
+    for (auto& content : block.lines())
+    {
+        if (offset < content.length())
+            break;
+        offset -= content.length();
+        ++line;
+    }
+    return line;
+}
+
+void LineList::check_invariant() const
+{
+#ifdef KAK_DEBUG
+    LineCount begin = 0;
+    for (auto& block : m_blocks)
+    {
+        kak_assert(block.begin == begin);
+        kak_assert(block.size() != 0);
+        kak_assert(not block.lazy_starts.empty() or
+                   (block.packed and block.bytes == (int)block.packed->ends.back()) or
+                   block.bytes == lines_byte_count(block.lines().data(),
+                                                   block.lines().data() + block.lines().size()));
+        kak_assert(block.infos.empty() or block.infos.size() == block.size());
+        begin += (int)block.size();
+    }
+    kak_assert(begin == m_line_count);
+    kak_assert(m_blocks.empty() or not m_blocks.back().lines().empty());
+#endif
+}
+
+}
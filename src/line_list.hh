@@ -0,0 +1,282 @@
+#ifndef line_list_hh_INCLUDED
+#define line_list_hh_INCLUDED
+
+#include "assert.hh"
+#include "string.hh"
+#include "units.hh"
+
+#include <functional>
+#include <memory>
+#include <vector>
+
+namespace Kakoune
+{
+
+// A LineList holds the lines of a buffer.
+//
+// Lines are stored in a sequence of blocks of bounded size, so that
+// inserting or erasing lines only moves the lines of the blocks that
+// are touched instead of every line after the modification point.
+// Finding the block holding a given line is a binary search on the
+// block start lines.
+//
+// Blocks also track their size in bytes, giving byte offset to line
+// conversions by searching the blocks first and then scanning the lines
+// of a single block. The byte offset at which each block starts is only
+// recomputed when needed, so that edits do not pay for it.
+//
+// A LineList can also be loaded lazily from some external data, such
+// as a file, in which case blocks only store where their lines are in
+// that data, and read them when first accessed.
+//
+// Blocks that are not accessed can be packed, their lines being stored
+// contiguously in a single allocation along with their end offsets,
+// instead of a String each. They are unpacked when accessed again. Packing
+// invalidates the references to the lines of the packed blocks.
+//
+// The lines of a block are reference counted so that snapshots can share
+// them, a block shared with a snapshot copies its lines before modifying
+// them. As the LineList never modifies shared lines, snapshots can be read
+// from other threads.
+class LineList
+{
+public:
+    LineList() = default;
+    LineList(LineList&&) = default;
+    LineList& operator=(LineList&&) = default;
+
+    [[gnu::always_inline]]
+    const String& operator[](LineCount line) const
+    {
+        const unsigned index = (unsigned)(int)(line - m_cache_begin);
+        if (index >= m_cache_size)
+            return lookup(line);
+        return m_cache_lines[index];
+    }
+
+    LineCount size() const { return m_line_count; }
+    bool empty() const { return m_line_count == 0; }
+
+    // the last block is never lazy, see assign
+    const String& back() const { return m_blocks.back().lines().back(); }
+
+    // properties of a line, computed on first access and kept until the
+    // line is modified, so that display and cursor movement code can
+    // skip utf-8 decoding or scanning lines that do not need it.
+    struct LineInfo
+    {
+        CharCount char_count = -1; // -1 until computed
+        bool ascii;                // bytes and characters are the same
+        bool has_tab;
+        bool has_unprintable;      // non printable characters, tabs included
+    };
+    const LineInfo& info(LineCount line) const;
+
+    // replace the content of given line
+    void set(LineCount line, String content);
+    // replace length bytes at column of given line with content, in place,
+    // content must not contain a new line
+    void replace_in_line(LineCount line, ByteCount column, ByteCount length,
+                         StringView content);
+
+    // reads length bytes at offset of the data given to assign into
+    // buffer, throws if they cannot be read
+    using LazyReader = std::function<void (size_t offset, size_t length, char* buffer)>;
+
+    void assign(std::vector<String> lines);
+    // lazily load lines from data, line_starts gives the start of each
+    // line, lines ending with \n, \r\n, \r or the end of data. data
+    // does not need to outlive the call, reader reads the lines from its
+    // source when they are first accessed. Without reader, data is copied
+    // in packed blocks.
+    void assign(StringView data, const std::vector<const char*>& line_starts,
+                LazyReader reader);
+    void clear();
+
+    // packs the blocks that were not accessed recently
+    void pack();
+
+    // true if some lines are still to be loaded
+    bool is_lazy() const { return m_lazy_blocks != 0; }
+    // loads the lines that were not accessed yet
+    void load_all() const;
+
+    // insert lines before line pos, pos can be size() to append
+    void insert(LineCount pos, std::vector<String> lines);
+    void push_back(String line);
+    // erase lines in [first, last)
+    void erase(LineCount first, LineCount last);
+
+    struct Replacement
+    {
+        LineCount first;
+        LineCount last;
+        size_t    count;
+    };
+    // replace lines in [first, last) with the next count lines from lines
+    // for each replacement, which must be sorted and not overlapping. This
+    // is a single pass over the blocks.
+    void replace(const std::vector<Replacement>& replacements, std::vector<String> lines);
+
+    // total size of the lines, in bytes
+    ByteCount byte_count() const;
+    // number of bytes before given line, line can be size()
+    ByteCount line_offset(LineCount line) const;
+    // line containing byte at given offset, must be less than byte_count()
+    LineCount line_at_offset(ByteCount offset) const;
+
+    size_t block_count() const { return m_blocks.size(); }
+    // bytes used to store the lines
+    size_t memory() const;
+
+private:
+    // lines stored contiguously, each of them ending at its ends offset
+    struct PackedLines
+    {
+        std::unique_ptr<char[]> data;
+        std::vector<uint32_t> ends;
+    };
+
+public:
+    // An immutable view of the lines at the time it was taken, sharing
+    // their storage with the LineList.
+    class Snapshot
+    {
+    public:
+        LineCount size() const { return m_line_count; }
+        ByteCount byte_count() const { return m_byte_count; }
+        // lines end with \n, as in the LineList
+        StringView operator[](LineCount line) const;
+        // same, block being the index of the block of a previously read
+        // line, updated to the one of line, so that reading the following
+        // lines does not search their block again
+        StringView line(LineCount line, int& block) const;
+
+    private:
+        friend class LineList;
+        struct Block
+        {
+            LineCount begin;
+            std::shared_ptr<const std::vector<String>> lines;
+            std::shared_ptr<const PackedLines> packed;
+        };
+        StringView line_in_block(const Block& block, LineCount line) const;
+
+        std::vector<Block> m_blocks;
+        LineCount m_line_count = 0;
+        ByteCount m_byte_count = 0;
+    };
+    // lazy lines are loaded first, the other lines are shared
+    Snapshot snapshot() const;
+
+    void check_invariant() const;
+
+    class const_iterator : public std::iterator<std::forward_iterator_tag, const String>
+    {
+    public:
+        const_iterator(const LineList& list, size_t block, size_t line)
+            : m_list(&list), m_block(block), m_line(line) {}
+
+        const String& operator*() const { return m_list->block_lines(m_block)[m_line]; }
+        const String* operator->() const { return &**this; }
+
+        const_iterator& operator++()
+        {
+            if (++m_line == m_list->block_lines(m_block).size())
+            {
+                ++m_block;
+                m_line = 0;
+            }
+            return *this;
+        }
+
+        bool operator==(const const_iterator& other) const
+        { return m_block == other.m_block and m_line == other.m_line; }
+        bool operator!=(const const_iterator& other) const
+        { return not (*this == other); }
+
+    private:
+        const LineList* m_list;
+        size_t m_block;
+        size_t m_line;
+    };
+
+    const_iterator begin() const { return { *this, 0, 0 }; }
+    const_iterator end() const { return { *this, m_blocks.size(), 0 }; }
+
+private:
+    static constexpr size_t target_block_size = 512;
+    static constexpr size_t max_block_size = 2 * target_block_size;
+    static constexpr size_t min_block_size = target_block_size / 4;
+    // blocks accessed by the last accesses are not packed
+    static constexpr size_t recent_access_count = 256;
+
+    struct Block
+    {
+        LineCount begin;
+        ByteCount bytes;
+        mutable ByteCount byte_begin;
+        // null when empty, use LineList::mutable_lines to modify them
+        mutable std::shared_ptr<std::vector<String>> shared_lines;
+
+        const std::vector<String>& lines() const
+        {
+            static const std::vector<String> empty;
+            return shared_lines ? *shared_lines : empty;
+        }
+
+        // lazy blocks store the range of their data, and the offset of
+        // their lines in it, and have no lines until loaded
+        size_t lazy_offset = 0;
+        size_t lazy_length = 0;
+        mutable std::vector<uint32_t> lazy_starts;
+
+        // packed blocks have no lines until unpacked
+        mutable std::shared_ptr<const PackedLines> packed;
+        // value of m_access_clock when last accessed
+        mutable size_t last_access = 0;
+
+        // info of the lines, empty until one is requested
+        mutable std::vector<LineInfo> infos;
+
+        size_t size() const
+        {
+            if (not lazy_starts.empty())
+                return lazy_starts.size();
+            if (packed)
+                return packed->ends.size();
+            return lines().size();
+        }
+    };
+
+    size_t find_block(LineCount line) const;
+    const String& lookup(LineCount line) const;
+    void load(const Block& block) const;
+    const std::vector<String>& block_lines(size_t index) const;
+    // lines of a loaded block, copied first if shared with a snapshot
+    std::vector<String>& mutable_lines(const Block& block) const;
+    void replace_blocks(size_t first, size_t last, std::vector<String> lines);
+    void update_block_begins(size_t first);
+    void update_byte_begins(size_t last) const;
+    void invalidate_byte_begins(size_t first);
+
+    std::vector<Block> m_blocks;
+    LineCount m_line_count = 0;
+    // number of leading blocks whose byte_begin is up to date
+    mutable size_t m_valid_byte_begins = 0;
+
+    mutable LazyReader m_lazy_reader;
+    mutable size_t m_lazy_blocks = 0;
+
+    mutable size_t m_access_clock = 0;
+
+    // lines of the last accessed block, most accesses being sequential
+    // this avoids looking up the block most of the time.
+    mutable const String* m_cache_lines = nullptr;
+    mutable LineCount     m_cache_begin = 0;
+    mutable unsigned      m_cache_size = 0;
+};
+
+}
+
+#endif // line_list_hh_INCLUDED
@@ -40,69 +40,204 @@ struct LineChange
     LineCount num;
 };
 
-}
+using LineModificationList = std::vector<LineModification>;
 
-std::vector<LineModification> compute_line_modifications(const Buffer& buffer, size_t timestamp)
+// folds change into res, costs the number of modifications after it
+void fold_change(LineModificationList& res, const LineChange& change)
 {
-    std::vector<LineModification> res;
-    for (auto& buf_change : buffer.changes_since(timestamp))
+    auto pos = std::upper_bound(res.begin(), res.end(), change.pos,
+                                [](const LineCount& l, const LineModification& c)
+                                { return l < c.new_line; });
+
+    if (pos != res.begin())
     {
-        const LineChange change(buf_change);
+        auto& prev = *(pos-1);
+        if (change.pos <= prev.new_line + prev.num_added)
+            --pos;
+        else
+            pos = res.insert(pos, {change.pos - prev.diff(), change.pos, 0, 0});
+    }
+    else
+        pos = res.insert(pos, {change.pos, change.pos, 0, 0});
 
-        auto pos = std::upper_bound(res.begin(), res.end(), change.pos,
-                                    [](const LineCount& l, const LineModification& c)
-                                    { return l < c.new_line; });
+    auto& modif = *pos;
+    auto next = pos + 1;
+    if (change.num > 0)
+    {
+        modif.num_added += change.num;
+        for (auto it = next; it != res.end(); ++it)
+            it->new_line += change.num;
+    }
+    if (change.num < 0)
+    {
+        const LineCount num_removed = -change.num;
 
-        if (pos != res.begin())
-        {
-            auto& prev = *(pos-1);
-            if (change.pos <= prev.new_line + prev.num_added)
-                --pos;
-            else
-                pos = res.insert(pos, {change.pos - prev.diff(), change.pos, 0, 0});
-        }
-        else
-            pos = res.insert(pos, {change.pos, change.pos, 0, 0});
+        auto delend = std::upper_bound(next, res.end(), change.pos + num_removed,
+                                       [](const LineCount& l, const LineModification& c)
+                                       { return l < c.new_line; });
 
-        auto& modif = *pos;
-        auto next = pos + 1;
-        if (change.num > 0)
+        for (auto it = next; it != delend; ++it)
         {
-            modif.num_added += change.num;
-            for (auto it = next; it != res.end(); ++it)
-                it->new_line += change.num;
+            LineCount removed_from_it = (change.pos + num_removed - it->new_line);
+            modif.num_removed += it->num_removed - std::min(removed_from_it, it->num_added);
+            modif.num_added += std::max(0_line, it->num_added - removed_from_it);
         }
-        if (change.num < 0)
-        {
-            const LineCount num_removed = -change.num;
+        next = res.erase(next, delend);
+
+        const LineCount num_added_after_pos =
+            modif.new_line + modif.num_added - change.pos;
+        const LineCount num_removed_from_added =
+            std::min(num_removed, num_added_after_pos);
+
+        kak_assert(modif.num_added >= num_removed_from_added);
 
-            auto delend = std::upper_bound(next, res.end(), change.pos + num_removed,
-                                           [](const LineCount& l, const LineModification& c)
-                                           { return l < c.new_line; });
+        modif.num_added -= num_removed_from_added;
+        modif.num_removed += num_removed - num_removed_from_added;
+
+        for (auto it = next; it != res.end(); ++it)
+            it->new_line -= num_removed;
+    }
+}
 
-            for (auto it = next; it != delend; ++it)
+// Composes first, from buffer state a to b, with second, from b to c, into
+// the modifications from a to c. Modifications replace the lines
+// [old_line, old_line + num_removed] with [new_line, new_line + num_added],
+// the ones overlapping in b are merged, in a single pass over both lists.
+LineModificationList compose(const LineModificationList& first,
+                             const LineModificationList& second)
+{
+    if (first.empty())
+        return second;
+    if (second.empty())
+        return first;
+
+    LineModificationList res;
+    res.reserve(first.size() + second.size());
+
+    // line delta of the modifications of each list before the current group
+    LineCount first_diff = 0, second_diff = 0;
+    auto it1 = first.begin(), it2 = second.begin();
+    while (it1 != first.end() or it2 != second.end())
+    {
+        // start of the group in b, and end past it
+        const bool from_first = it2 == second.end() or
+                                (it1 != first.end() and it1->new_line <= it2->old_line);
+        const LineCount begin = from_first ? it1->new_line : it2->old_line;
+        LineCount end = begin;
+
+        const LineCount group_first_diff = first_diff;
+        const LineCount group_second_diff = second_diff;
+        while (true)
+        {
+            if (it1 != first.end() and it1->new_line <= end and
+                (it1->new_line < end or end == begin))
             {
-                LineCount removed_from_it = (change.pos + num_removed - it->new_line);
-                modif.num_removed += it->num_removed - std::min(removed_from_it, it->num_added);
-                modif.num_added += std::max(0_line, it->num_added - removed_from_it);
+                end = std::max(end, it1->new_line + it1->num_added + 1);
+                first_diff += it1->num_added - it1->num_removed;
+                ++it1;
             }
-            next = res.erase(next, delend);
+            else if (it2 != second.end() and it2->old_line <= end and
+                     (it2->old_line < end or end == begin))
+            {
+                end = std::max(end, it2->old_line + it2->num_removed + 1);
+                second_diff += it2->num_added - it2->num_removed;
+                ++it2;
+            }
+            else
+                break;
+        }
 
-            const LineCount num_added_after_pos =
-                modif.new_line + modif.num_added - change.pos;
-            const LineCount num_removed_from_added =
-                std::min(num_removed, num_added_after_pos);
+        const LineCount old_line = begin - group_first_diff;
+        const LineCount new_line = begin + group_second_diff;
+        res.push_back({ old_line, new_line,
+                        end - first_diff - old_line - 1,
+                        end + second_diff - new_line - 1 });
+    }
+    return res;
+}
 
-            kak_assert(modif.num_added >= num_removed_from_added);
+// Folds the changes in lists of modifications to which each change only
+// gets appended, so that fold_change is constant time, then composes these
+// lists pairwise. Scattered changes are thus folded in O(n log n) instead
+// of shifting all the following modifications for each of them.
+LineModificationList fold_changes(memoryview<Buffer::Change> changes)
+{
+    std::vector<LineModificationList> runs;
+    for (auto& buf_change : changes)
+    {
+        const LineChange change(buf_change);
+        if (runs.empty() or (not runs.back().empty() and
+                             change.pos < runs.back().back().new_line))
+            runs.emplace_back();
+        fold_change(runs.back(), change);
+    }
 
-            modif.num_added -= num_removed_from_added;
-            modif.num_removed += num_removed - num_removed_from_added;
+    while (runs.size() > 1)
+    {
+        for (size_t i = 0; i < runs.size(); i += 2)
+            runs[i/2] = i + 1 < runs.size() ? compose(runs[i], runs[i+1])
+                                            : std::move(runs[i]);
+        runs.resize((runs.size() + 1) / 2);
+    }
+    return runs.empty() ? LineModificationList{} : std::move(runs[0]);
+}
 
-            for (auto it = next; it != res.end(); ++it)
-                it->new_line -= num_removed;
-        }
+// Consumers such as the regions highlighters ask for the same timestamp
+// on each redraw. The modifications since a timestamp are kept per buffer,
+// and only the changes since their computation are folded on top of them.
+struct LineModificationCache
+{
+    struct Entry
+    {
+        size_t timestamp;      // start of the modifications
+        size_t end_timestamp;  // buffer timestamp they were computed at
+        LineModificationList modifications;
+    };
+    // most recently used last
+    std::vector<Entry> entries;
+
+    static constexpr size_t max_entries = 8;
+};
+
+}
+
+std::vector<LineModification> compute_line_modifications(const Buffer& buffer, size_t timestamp)
+{
+    const size_t buffer_timestamp = buffer.timestamp();
+    if (timestamp == buffer_timestamp)
+        return {};
+
+    static const ValueId cache_id = ValueId::get_free_id();
+    Value& cache_val = buffer.values()[cache_id];
+    if (not cache_val)
+        cache_val = Value(LineModificationCache{});
+    auto& entries = cache_val.as<LineModificationCache>().entries;
+
+    auto it = std::find_if(entries.begin(), entries.end(),
+                           [&](const LineModificationCache::Entry& entry)
+                           { return entry.timestamp == timestamp; });
+    LineModificationCache::Entry entry;
+    if (it != entries.end() and buffer.changes_available_since(it->end_timestamp))
+    {
+        entry = std::move(*it);
+        entries.erase(it);
+        if (entry.end_timestamp != buffer_timestamp)
+            entry.modifications = compose(entry.modifications,
+                                          fold_changes(buffer.changes_since(entry.end_timestamp)));
     }
-    return res;
+    else
+    {
+        if (it != entries.end())
+            entries.erase(it);
+        entry.timestamp = timestamp;
+        entry.modifications = fold_changes(buffer.changes_since(timestamp));
+    }
+    entry.end_timestamp = buffer_timestamp;
+
+    if (entries.size() == LineModificationCache::max_entries)
+        entries.erase(entries.begin());
+    entries.push_back(std::move(entry));
+    return entries.back().modifications;
 }
 
 }
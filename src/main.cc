@@ -10,14 +10,17 @@
 #include "event_manager.hh"
 #include "face_registry.hh"
 #include "file.hh"
+#include "file_watcher.hh"
 #include "highlighters.hh"
 #include "hook_manager.hh"
 #include "keymap_manager.hh"
 #include "ncurses.hh"
+#include "normal.hh"
 #include "option_manager.hh"
 #include "parameters_parser.hh"
 #include "register_manager.hh"
 #include "remote.hh"
+#include "search_index.hh"
 #include "shell_manager.hh"
 #include "string.hh"
 #include "interned_string.hh"
@@ -132,7 +135,12 @@ void register_env_vars()
             "cursor_char_column",
             [](StringView name, const Context& context)
             { auto coord = context.selections().main().cursor();
-              return to_string(context.buffer()[coord.line].char_count_to(coord.column) + 1); }
+              return to_string(context.buffer().char_count_to(coord) + 1); }
+        }, {
+            "cursor_byte_offset",
+            [](StringView name, const Context& context)
+            { auto cursor = context.selections().main().cursor();
+              return to_string(context.buffer().byte_offset(cursor)); }
         }, {
             "selection_desc",
             [](StringView name, const Context& context)
@@ -155,6 +163,17 @@ void register_env_vars()
                 }
                 return res;
             }
+        }, {
+            "search_match_count",
+            [](StringView name, const Context& context)
+            { auto index = current_search_index(context);
+              return index ? to_string(index->matches().size()) : String{}; }
+        }, {
+            "search_match_index",
+            [](StringView name, const Context& context)
+            { auto index = current_search_index(context);
+              auto coord = context.selections().main().min();
+              return index ? to_string(index->count_until(coord)) : String{}; }
         }, {
             "window_width",
             [](StringView name, const Context& context)
@@ -209,7 +228,11 @@ void create_local_client(const String& init_command)
     {
         ~LocalNCursesUI()
         {
-            if (not ClientManager::instance().empty() and fork())
+            if (ClientManager::instance().empty())
+                return;
+            // the writing threads are not duplicated by fork
+            wait_for_background_writes();
+            if (fork())
             {
                 this->NCursesUI::~NCursesUI();
                 puts("detached from terminal\n");
@@ -312,6 +335,8 @@ int run_server(StringView session, StringView init_command,
     ShellManager        shell_manager;
     CommandManager      command_manager;
     BufferManager       buffer_manager;
+    FileWatcher         file_watcher;
+    BackgroundWrites    background_writes;
     RegisterManager     register_manager;
     HighlighterRegistry highlighter_registry;
     DefinedHighlighters defined_highlighters;
@@ -378,6 +403,7 @@ int run_server(StringView session, StringView init_command,
         buffer_manager.clear_buffer_trash();
         client_manager.redraw_clients();
     }
+    wait_for_background_writes();
 
     {
         Context empty_context;
@@ -446,16 +472,15 @@ int run_filter(StringView keystr, memoryview<StringView> files)
 
 int run_pipe(StringView session)
 {
-    char buf[512];
     String command;
-    while (ssize_t count = read(0, buf, 512))
+    try
     {
-        if (count < 0)
-        {
-            fprintf(stderr, "error while reading stdin\n");
-            return -1;
-        }
-        command += String{buf, buf + count};
+        command = read_fd(0);
+    }
+    catch (runtime_error& e)
+    {
+        fprintf(stderr, "error while reading stdin: %s\n", e.what());
+        return -1;
     }
     try
     {
@@ -414,24 +414,25 @@ void pipe(Context& context, int)
         });
 }
 
-template<Direction direction, SelectMode mode>
+// pattern is either a Regex or a SearchIndex
+template<Direction direction, SelectMode mode, typename Pattern>
 void select_next_match(const Buffer& buffer, SelectionList& selections,
-                       const Regex& regex)
+                       const Pattern& pattern)
 {
     if (mode == SelectMode::Replace)
     {
         for (auto& sel : selections)
-            sel = keep_direction(find_next_match<direction>(buffer, sel, regex), sel);
+            sel = keep_direction(find_next_match<direction>(buffer, sel, pattern), sel);
     }
     if (mode == SelectMode::Extend)
     {
         for (auto& sel : selections)
-            sel.merge_with(find_next_match<direction>(buffer, sel, regex));
+            sel.merge_with(find_next_match<direction>(buffer, sel, pattern));
     }
     else if (mode == SelectMode::Append)
     {
         auto sel = keep_direction(
-            find_next_match<direction>(buffer, selections.main(), regex),
+            find_next_match<direction>(buffer, selections.main(), pattern),
             selections.main());
         selections.push_back(std::move(sel));
         selections.set_main_index(selections.size() - 1);
@@ -602,10 +603,19 @@ void search_next(Context& context, int param)
     {
         try
         {
-            Regex ex{str.begin(), str.end()};
-            do {
-                select_next_match<direction, mode>(context.buffer(), context.selections(), ex);
-            } while (--param > 0);
+            if (auto index = SearchIndex::get(context.buffer(), str))
+            {
+                do {
+                    select_next_match<direction, mode>(context.buffer(), context.selections(), *index);
+                } while (--param > 0);
+            }
+            else
+            {
+                Regex ex{str.begin(), str.end()};
+                do {
+                    select_next_match<direction, mode>(context.buffer(), context.selections(), ex);
+                } while (--param > 0);
+            }
         }
         catch (boost::regex_error& err)
         {
@@ -616,6 +626,14 @@ void search_next(Context& context, int param)
         throw runtime_error("no search pattern");
 }
 
+const SearchIndex* current_search_index(const Context& context)
+{
+    StringView str = context.main_sel_register_value("/");
+    if (str.empty())
+        return nullptr;
+    return SearchIndex::get_if_up_to_date(context.buffer(), str);
+}
+
 template<bool smart>
 void use_selection_as_search_pattern(Context& context, int)
 {
@@ -729,11 +747,14 @@ void keep(Context& context, int)
         if (ex.empty())
             return;
         const Buffer& buffer = context.buffer();
+        const SegmentIterator buffer_end{buffer, buffer.end_coord()};
+        MatchResults matches;
         std::vector<Selection> keep;
         for (auto& sel : context.selections())
         {
-            if (boost::regex_search(buffer.iterator_at(sel.min()),
-                                    utf8::next(buffer.iterator_at(sel.max()), buffer.end()), ex) == matching)
+            if (find_first_match(SegmentIterator{buffer, sel.min()},
+                                 utf8::next(SegmentIterator{buffer, sel.max()}, buffer_end),
+                                 matches, ex) == matching)
                 keep.push_back(sel);
         }
         if (keep.empty())
@@ -10,6 +10,7 @@ namespace Kakoune
 {
 
 class Context;
+class SearchIndex;
 
 struct NormalCmdDesc
 {
@@ -20,6 +21,11 @@ struct NormalCmdDesc
 using KeyMap = std::unordered_map<Key, NormalCmdDesc>;
 extern KeyMap keymap;
 
+// index of the search register regex in the context buffer, null when
+// the register is empty or when it was not updated by a search since the
+// last buffer modification. The buffer is not searched.
+const SearchIndex* current_search_index(const Context& context);
+
 }
 
 #endif // normal_hh_INCLUDED
@@ -139,6 +139,12 @@ GlobalOptions::GlobalOptions()
     declare_option("eolformat", "end of line format: 'crlf' or 'lf'", "lf"_str);
     declare_option("BOM", "insert a byte order mark when writing buffer",
                    "no"_str);
+    declare_option("atomicwrite",
+                   "write files to a temporary file renamed over the original",
+                   false);
+    declare_option("undo_memory_limit",
+                   "bytes of undo history text kept in memory, older text is moved to a temporary file",
+                   64 * 1024 * 1024);
     declare_option("complete_prefix",
                    "complete up to common prefix in tab completion",
                    true);
@@ -0,0 +1,125 @@
+#include "regex_search.hh"
+
+namespace Kakoune
+{
+
+String literal_prefix(const Regex& regex)
+{
+    if (regex.empty() or (regex.flags() & (Regex::icase | Regex::mod_x)))
+        return {};
+
+    const std::string source = regex.str();
+    // alternatives and inline modifiers could apply to the prefix
+    if (source.find('|') != std::string::npos or source.find("(?") != std::string::npos)
+        return {};
+
+    auto it = source.begin(), end = source.end();
+    // zero width assertions do not consume anything
+    while (it != end)
+    {
+        if (*it == '^')
+            ++it;
+        else if (*it == '\\' and it + 1 != end and strchr("b<>`'", it[1]))
+            it += 2;
+        else
+            break;
+    }
+
+    String prefix;
+    while (it != end)
+    {
+        char c = *it;
+        if (c == '\\')
+        {
+            // only escaped punctuation is a literal, other escapes are
+            // classes, assertions or control characters, and \< \> \` \'
+            // are zero width assertions
+            if (it + 1 == end or not ispunct((unsigned char)it[1]) or
+                strchr("<>`'", it[1]))
+                break;
+            c = it[1];
+            it += 2;
+        }
+        else if (strchr(".[]{}()*+?|^$", c))
+            break;
+        else
+            ++it;
+
+        if (c == '\n')
+            break;
+        // a quantified literal might not be there
+        if (it != end and strchr("*?{", *it))
+            break;
+        prefix += c;
+        if (it != end and *it == '+')
+            break;
+    }
+    return prefix;
+}
+
+// true if the regex source has one of escapes after a backslash, or one
+// of tokens unescaped
+static bool has_any(const Regex& regex, const char* escapes,
+                    std::initializer_list<const char*> tokens)
+{
+    const std::string source = regex.str();
+    for (size_t i = 0; i < source.length(); ++i)
+    {
+        if (source[i] == '\\')
+        {
+            if (++i < source.length() and strchr(escapes, source[i]))
+                return true;
+            continue;
+        }
+        for (auto token : tokens)
+        {
+            if (source.compare(i, strlen(token), token) == 0)
+                return true;
+        }
+    }
+    return false;
+}
+
+bool has_lookbehind(const Regex& regex)
+{
+    return has_any(regex, "", { "(?<=", "(?<!" });
+}
+
+bool has_lookahead(const Regex& regex)
+{
+    return has_any(regex, "bB<>zZ'", { "$", "(?=", "(?!" });
+}
+
+bool may_span_lines(const Regex& regex)
+{
+    const std::string source = regex.str();
+    for (size_t i = 0; i < source.length(); ++i)
+    {
+        const unsigned char c = source[i];
+        if (c == '\\')
+        {
+            // escaped punctuation, word and digit classes and word
+            // boundaries stay on their line
+            if (++i == source.length() or
+                not (ispunct((unsigned char)source[i]) or strchr("bBwd<>", source[i])))
+                return true;
+        }
+        // any character, negated or named classes, lookarounds and
+        // modifiers, control characters that could start a range
+        else if (c == '.' or c < ' ' or
+                 source.compare(i, 2, "[^") == 0 or source.compare(i, 2, "[:") == 0 or
+                 source.compare(i, 2, "(?") == 0)
+            return true;
+    }
+    return false;
+}
+
+bool find_first_match(const SegmentIterator& begin, const SegmentIterator& end,
+                      MatchResults& matches, const Regex& regex,
+                      RegexFlags flags)
+{
+    return find_first_match(begin, end, matches, regex,
+                            literal_prefix(regex), flags, begin);
+}
+
+}
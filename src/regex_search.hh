@@ -0,0 +1,155 @@
+#ifndef regex_search_hh_INCLUDED
+#define regex_search_hh_INCLUDED
+
+#include "segment_iterator.hh"
+#include "string.hh"
+
+#include <boost/regex.hpp>
+
+namespace Kakoune
+{
+
+using MatchResults = boost::match_results<SegmentIterator>;
+using RegexFlags = boost::regex_constants::match_flag_type;
+
+// literal every match of regex starts with, as far as a quick look at its
+// source can tell. Empty if there is none or the regex is too complex.
+String literal_prefix(const Regex& regex);
+
+// true if regex has lookbehind assertions, which can look at the text
+// before its matches further than the previous character.
+bool has_lookbehind(const Regex& regex);
+// true if regex has assertions that can look at the text after the
+// position they are checked at, like $, \b or lookaheads.
+bool has_lookahead(const Regex& regex);
+// false only if regex can neither match nor look past an end of line,
+// as far as a quick look at its source can tell.
+bool may_span_lines(const Regex& regex);
+
+// searches the first match of regex in [begin, end). When regex has a
+// literal prefix, the regex is only run where that literal is found,
+// using memchr/memmem to get there.
+bool find_first_match(const SegmentIterator& begin, const SegmentIterator& end,
+                      MatchResults& matches, const Regex& regex,
+                      RegexFlags flags = boost::match_default);
+
+// same with an already computed literal prefix, base being the start of
+// the searched range, which the regex may look back to.
+template<typename Iterator>
+bool find_first_match(const Iterator& begin, const Iterator& end,
+                      boost::match_results<Iterator>& matches, const Regex& regex,
+                      StringView prefix, RegexFlags flags, const Iterator& base)
+{
+    if (prefix.empty())
+        return boost::regex_search(begin, end, matches, regex, flags, base);
+
+    // every match starts with prefix, only try there. The regex can still
+    // look back up to base for assertions.
+    for (Iterator it = begin; ; ++it)
+    {
+        it.find(prefix, end);
+        if (it == end)
+            return false;
+        if (boost::regex_search(it, end, matches, regex,
+                                flags | boost::match_continuous, base))
+            return true;
+    }
+}
+
+// same, only finding a match starting before limit, a line start, instead
+// of searching up to end. Such a match can go on past limit.
+template<typename Iterator>
+bool find_first_match_before(Iterator pos, const Iterator& limit, const Iterator& end,
+                             boost::match_results<Iterator>& matches, const Regex& regex,
+                             StringView prefix, RegexFlags flags, const Iterator& base)
+{
+    using namespace boost::regex_constants;
+    if (limit == end)
+        return find_first_match(pos, end, matches, regex, prefix, flags, base);
+    if (not (pos.coord() < limit.coord()))
+        return false;
+
+    if (not prefix.empty())
+    {
+        // prefix has no end of line, when a match starts before limit its
+        // prefix ends before it as well
+        for (; ; ++pos, flags &= ~match_not_initial_null)
+        {
+            pos.find(prefix, limit);
+            if (pos == limit)
+                return false;
+            if (boost::regex_search(pos, end, matches, regex,
+                                    flags | match_continuous, base))
+                return true;
+        }
+    }
+
+    // searching up to limit finds either a match starting before it, which
+    // may have been cut short, or a partial match reaching it. Either way,
+    // match again from there up to end.
+    while (boost::regex_search(pos, limit, matches, regex,
+                               flags | match_partial | match_not_eol |
+                               match_not_eow | match_not_eob, base))
+    {
+        const Iterator match_begin = matches[0].first;
+        if (match_begin == limit)
+            return false;
+        if (boost::regex_search(match_begin, end, matches, regex,
+                                (match_begin == pos ? flags : flags & ~match_not_initial_null) |
+                                match_continuous, base))
+            return true;
+        pos = match_begin;
+        ++pos;
+        flags &= ~match_not_initial_null;
+    }
+    return false;
+}
+
+// Iterates over the matches of a regex like boost::regex_iterator does,
+// going through find_first_match.
+class RegexIterator
+{
+public:
+    RegexIterator() = default;
+    RegexIterator(const SegmentIterator& begin, const SegmentIterator& end,
+                  const Regex& regex, RegexFlags flags = boost::match_default)
+        : m_regex{&regex}, m_prefix{literal_prefix(regex)},
+          m_base{begin}, m_end{end}, m_flags{flags}
+    {
+        if (not find_first_match(begin, end, m_results, regex, m_prefix, flags, m_base))
+            m_regex = nullptr;
+    }
+
+    const MatchResults& operator*() const { return m_results; }
+    const MatchResults* operator->() const { return &m_results; }
+
+    RegexIterator& operator++()
+    {
+        // same as boost::regex_iterator, avoid matching the same empty
+        // match again, the regex can look back up to m_base
+        RegexFlags flags = m_flags;
+        if (m_results[0].first == m_results[0].second)
+            flags |= boost::regex_constants::match_not_initial_null;
+        const SegmentIterator begin = m_results[0].second;
+        if (not find_first_match(begin, m_end, m_results, *m_regex, m_prefix, flags, m_base))
+            m_regex = nullptr;
+        return *this;
+    }
+
+    bool operator==(const RegexIterator& other) const
+    { return m_regex == nullptr and other.m_regex == nullptr; }
+    bool operator!=(const RegexIterator& other) const
+    { return not (*this == other); }
+
+private:
+    const Regex* m_regex = nullptr;
+    String m_prefix;
+    SegmentIterator m_base;
+    SegmentIterator m_end;
+    RegexFlags m_flags = boost::match_default;
+    MatchResults m_results;
+};
+
+}
+
+#endif // regex_search_hh_INCLUDED
@@ -0,0 +1,253 @@
+#include "search_index.hh"
+
+#include "buffer.hh"
+#include "line_modification.hh"
+#include "value.hh"
+
+#include <algorithm>
+
+namespace Kakoune
+{
+
+static ValueId index_id()
+{
+    static const ValueId id = ValueId::get_free_id();
+    return id;
+}
+
+const SearchIndex* SearchIndex::get(const Buffer& buffer, StringView regex)
+{
+    if ((size_t)(int)buffer.byte_offset(buffer.end_coord()) > max_size)
+    {
+        drop(buffer);
+        return nullptr;
+    }
+
+    Value& index_val = buffer.values()[index_id()];
+    if (not index_val)
+        index_val = Value(SearchIndex{});
+    auto& index = index_val.as<SearchIndex>();
+
+    if (index.m_regex_str != regex or index.m_regex.empty())
+    {
+        index.m_regex = Regex{regex.begin(), regex.end()};
+        index.m_regex_str = regex;
+        index.m_prefix = literal_prefix(index.m_regex);
+        index.m_span_lines = may_span_lines(index.m_regex);
+        index.m_timestamp = invalid_timestamp;
+    }
+    index.update(buffer);
+    if (index.m_matches.size() > max_match_count)
+    {
+        drop(buffer);
+        return nullptr;
+    }
+    return &index;
+}
+
+const SearchIndex* SearchIndex::get_if_up_to_date(const Buffer& buffer, StringView regex)
+{
+    auto it = buffer.values().find(index_id());
+    if (it == buffer.values().end())
+        return nullptr;
+    auto& index = it->second.as<SearchIndex>();
+    if (index.m_regex_str != regex or index.m_timestamp != buffer.timestamp())
+        return nullptr;
+    return &index;
+}
+
+void SearchIndex::drop(const Buffer& buffer)
+{
+    buffer.values().erase(index_id());
+}
+
+static bool has_empty_match(const std::vector<SearchIndex::Match>& matches)
+{
+    return std::any_of(matches.begin(), matches.end(),
+                       [](const SearchIndex::Match& match) { return match.begin == match.end; });
+}
+
+bool SearchIndex::can_update(const Buffer& buffer) const
+{
+    // a match spanning lines can start anywhere before a modification
+    // that completes it, only searching the whole buffer finds it.
+    return m_timestamp == buffer.timestamp() or
+           (m_timestamp != invalid_timestamp and not m_span_lines and
+            buffer.changes_available_since(m_timestamp));
+}
+
+void SearchIndex::update(const Buffer& buffer)
+{
+    if (m_timestamp == buffer.timestamp())
+        return;
+
+    if (not can_update(buffer))
+    {
+        m_timestamp = buffer.timestamp();
+        m_matches.clear();
+        search(buffer, {0,0}, buffer.end_coord(), m_matches);
+        m_has_empty_matches = has_empty_match(m_matches);
+        return;
+    }
+
+    auto modifs = compute_line_modifications(buffer, m_timestamp);
+    m_timestamp = buffer.timestamp();
+
+    // search again from the line before each modification to the line
+    // after it, extended to the lines of the removed matches reaching it
+    std::vector<LineCount> search_begins, search_ends;
+    search_begins.reserve(modifs.size());
+    search_ends.reserve(modifs.size());
+    for (auto& modif : modifs)
+    {
+        search_begins.push_back(modif.new_line - 1);
+        search_ends.push_back(modif.new_line + modif.num_added + 2);
+    }
+
+    // remove the matches touching a modified line and update the lines
+    // of the others
+    auto ins_pos = m_matches.begin();
+    for (auto it = ins_pos; it != m_matches.end(); ++it)
+    {
+        auto modif_it = std::lower_bound(modifs.begin(), modifs.end(), it->begin.line,
+                                         [](const LineModification& c, const LineCount& l)
+                                         { return c.old_line < l; });
+        const LineCount diff = modif_it != modifs.begin() ? (modif_it-1)->diff() : 0;
+
+        bool erase = (modif_it != modifs.end() and modif_it->old_line <= it->end.line);
+        if (erase)
+        {
+            auto last_it = std::upper_bound(modif_it, modifs.end(), it->end.line,
+                                            [](const LineCount& l, const LineModification& c)
+                                            { return l < c.old_line; }) - 1;
+            const LineCount end_line = std::max(it->end.line + last_it->diff(),
+                                                last_it->new_line + last_it->num_added);
+            const size_t index = modif_it - modifs.begin();
+            search_begins[index] = std::min(search_begins[index], it->begin.line + diff);
+            search_ends[index] = std::max(search_ends[index], end_line + 1);
+        }
+        else if (modif_it != modifs.begin())
+        {
+            auto& prev = *(modif_it-1);
+            erase = it->begin.line <= prev.old_line + prev.num_removed;
+            it->begin.line += diff;
+            it->end.line += diff;
+        }
+
+        if (not erase)
+        {
+            if (ins_pos != it)
+                *ins_pos = *it;
+            ++ins_pos;
+        }
+    }
+    m_matches.erase(ins_pos, m_matches.end());
+
+    // the kept matches starting in the searched ranges are replaced with the
+    // new ones, the ranges being extended over the kept matches reached by
+    // the new ones.
+    const LineCount line_count = buffer.line_count();
+    const ByteCoord buffer_end = buffer.end_coord();
+    auto line_start = [&](LineCount line) {
+        return line < line_count ? ByteCoord{std::max(0_line, line), 0} : buffer_end;
+    };
+
+    std::vector<Match> matches;
+    matches.reserve(m_matches.size());
+    auto kept = m_matches.begin();
+    for (size_t i = 0; i < modifs.size(); ++i)
+    {
+        ByteCoord begin = line_start(search_begins[i]);
+        ByteCoord end = line_start(search_ends[i]);
+
+        for (; kept != m_matches.end() and kept->begin < begin; ++kept)
+            matches.push_back(*kept);
+        if (not matches.empty())
+            begin = std::max(begin, matches.back().end);
+
+        while (begin < end)
+        {
+            for (; kept != m_matches.end() and (kept->begin < end or end == buffer_end); ++kept)
+                end = std::max(end, line_start(kept->end.line + 1));
+            search(buffer, begin, end, matches);
+
+            if (matches.empty() or matches.back().end <= end)
+                break;
+            begin = matches.back().end;
+            end = line_start(begin.line + 1);
+        }
+    }
+    matches.insert(matches.end(), kept, m_matches.end());
+    m_matches = std::move(matches);
+    m_has_empty_matches = has_empty_match(m_matches);
+}
+
+void SearchIndex::search(const Buffer& buffer, ByteCoord begin, ByteCoord end,
+                         std::vector<Match>& matches) const
+{
+    // like boost::regex_iterator, do not match the same empty match again
+    bool after_empty = not matches.empty() and matches.back().end == begin and
+                       matches.back().begin == begin;
+
+    const SegmentIterator end_it{buffer, end};
+    SegmentIterator pos{buffer, begin};
+    MatchResults results;
+    // the index is dropped once there are too many matches
+    while (matches.size() <= max_match_count and
+           find_match(buffer, pos, end_it, results, after_empty))
+    {
+        matches.push_back({results[0].first.coord(), results[0].second.coord()});
+        if (end < matches.back().end)
+            break;
+        pos = results[0].second;
+        after_empty = results[0].first == results[0].second;
+    }
+}
+
+bool SearchIndex::find_match(const Buffer& buffer, SegmentIterator pos,
+                             const SegmentIterator& end, MatchResults& results,
+                             bool not_initial_null) const
+{
+    using namespace boost::regex_constants;
+    return find_first_match_before(pos, end, SegmentIterator{buffer, buffer.end_coord()},
+                                   results, m_regex, m_prefix,
+                                   not_initial_null ? match_not_initial_null : match_default,
+                                   SegmentIterator{buffer, {0,0}});
+}
+
+size_t SearchIndex::next(ByteCoord coord) const
+{
+    kak_assert(not m_matches.empty());
+    auto it = std::lower_bound(m_matches.begin(), m_matches.end(), coord,
+                               [](const Match& match, const ByteCoord& coord)
+                               { return match.begin < coord; });
+    return it == m_matches.end() ? 0 : it - m_matches.begin();
+}
+
+size_t SearchIndex::previous(ByteCoord coord) const
+{
+    kak_assert(not m_matches.empty());
+    // matches do not overlap, so their ends are sorted as well
+    auto it = std::upper_bound(m_matches.begin(), m_matches.end(), coord,
+                               [](const ByteCoord& coord, const Match& match)
+                               { return coord < match.end; });
+    return (it == m_matches.begin() ? m_matches.end() : it) - m_matches.begin() - 1;
+}
+
+bool SearchIndex::inside_match(ByteCoord coord) const
+{
+    auto it = std::upper_bound(m_matches.begin(), m_matches.end(), coord,
+                               [](const ByteCoord& coord, const Match& match)
+                               { return coord < match.end; });
+    return it != m_matches.end() and it->begin < coord;
+}
+
+size_t SearchIndex::count_until(ByteCoord coord) const
+{
+    auto it = std::upper_bound(m_matches.begin(), m_matches.end(), coord,
+                               [](const ByteCoord& coord, const Match& match)
+                               { return coord < match.begin; });
+    return it - m_matches.begin();
+}
+
+}
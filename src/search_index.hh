@@ -0,0 +1,92 @@
+#ifndef search_index_hh_INCLUDED
+#define search_index_hh_INCLUDED
+
+#include "coord.hh"
+#include "regex_search.hh"
+#include "string.hh"
+
+#include <vector>
+
+namespace Kakoune
+{
+
+class Buffer;
+
+// The sorted matches of a search regex in a buffer, as found by iterating
+// over its matches from the buffer start.
+//
+// The index is stored with the buffer, and brought up to date when
+// requested again: only the lines around the modified ones are searched
+// again, so that going to the next or previous match after an edit is a
+// binary search instead of a scan of the buffer. The search starts from
+// the line before a modification, or from the start of a match reaching
+// it. A regex that may match over several lines can have a new match
+// starting anywhere before a modification, so its index is built again
+// from the whole buffer instead.
+//
+// As building the index searches the whole buffer, and the index takes
+// memory for each match, buffers above max_size bytes and regexes with
+// more than max_match_count matches are not indexed.
+class SearchIndex
+{
+public:
+    struct Match
+    {
+        ByteCoord begin;
+        ByteCoord end;
+    };
+
+    static constexpr size_t max_size = 4 * 1024 * 1024;
+    static constexpr size_t max_match_count = 64 * 1024;
+
+    // index of the matches of regex in buffer, building or updating it as
+    // needed, nullptr if it is not indexed. Throws boost::regex_error if
+    // regex is not valid
+    static const SearchIndex* get(const Buffer& buffer, StringView regex);
+    // index of the matches of regex in buffer if it was already built and
+    // the buffer was not modified since, nullptr otherwise
+    static const SearchIndex* get_if_up_to_date(const Buffer& buffer, StringView regex);
+    // releases the index of buffer
+    static void drop(const Buffer& buffer);
+
+    const Regex& regex() const { return m_regex; }
+    const std::vector<Match>& matches() const { return m_matches; }
+    bool has_empty_matches() const { return m_has_empty_matches; }
+
+    // index of the first match starting at or after coord, wrapping to the
+    // first match. There must be some matches.
+    size_t next(ByteCoord coord) const;
+    // index of the last match ending at or before coord, wrapping to the
+    // last match. There must be some matches.
+    size_t previous(ByteCoord coord) const;
+    // number of matches starting at or before coord
+    size_t count_until(ByteCoord coord) const;
+    // true if coord is after the start and before the end of a match
+    bool inside_match(ByteCoord coord) const;
+
+private:
+    // true if update only searches the lines around the modifications
+    bool can_update(const Buffer& buffer) const;
+    void update(const Buffer& buffer);
+    // appends the matches starting in [begin, end) to matches
+    void search(const Buffer& buffer, ByteCoord begin, ByteCoord end,
+                std::vector<Match>& matches) const;
+    // first match starting in [pos, end), which can go on past end
+    bool find_match(const Buffer& buffer, SegmentIterator pos,
+                    const SegmentIterator& end, MatchResults& results,
+                    bool not_initial_null) const;
+
+    static constexpr size_t invalid_timestamp = (size_t)-1;
+
+    String m_regex_str;
+    Regex  m_regex;
+    String m_prefix;
+    bool   m_span_lines = false;
+    size_t m_timestamp = invalid_timestamp;
+    std::vector<Match> m_matches;
+    bool m_has_empty_matches = false;
+};
+
+}
+
+#endif // search_index_hh_INCLUDED
@@ -0,0 +1,151 @@
+#ifndef segment_iterator_hh_INCLUDED
+#define segment_iterator_hh_INCLUDED
+
+#include "buffer.hh"
+
+#include <string.h>
+
+namespace Kakoune
+{
+
+inline LineCount line_count(const Buffer& buffer) { return buffer.line_count(); }
+inline LineCount line_count(const LineList::Snapshot& lines) { return lines.size(); }
+
+// block is a hint the lines can use to find the following lines faster
+inline StringView line_at(const Buffer& buffer, LineCount line, int& block)
+{ return buffer[line]; }
+inline StringView line_at(const LineList::Snapshot& lines, LineCount line, int& block)
+{ return lines.line(line, block); }
+
+// A bidirectional iterator over the bytes of a buffer that reads the
+// memory of its current line directly, going through the buffer only
+// when crossing a line boundary. Stepping it is much cheaper than
+// stepping a BufferIterator, which makes it the iterator of choice for
+// regex searches.
+//
+// Lines can be read from a Buffer, in which case the iterator is
+// invalidated by any modification of the buffer, or from a buffer
+// snapshot, which can be done from other threads.
+template<typename Lines>
+class BasicSegmentIterator
+{
+public:
+    using value_type = char;
+    using difference_type = std::ptrdiff_t;
+    using pointer = const char*;
+    using reference = const char&;
+    using iterator_category = std::bidirectional_iterator_tag;
+
+    BasicSegmentIterator() = default;
+    BasicSegmentIterator(const Lines& lines, ByteCoord coord)
+        : m_lines{&lines}, m_line{coord.line}
+    {
+        kak_assert(coord.line >= 0 and coord.line < line_count(lines));
+        m_pos = set_line() + (int)coord.column;
+        kak_assert(m_pos <= m_end);
+        // only the end of the last line is a valid position
+        if (m_pos == m_end and m_line + 1 < line_count(*m_lines))
+            next_line();
+    }
+
+    const char& operator*() const { return *m_pos; }
+
+    BasicSegmentIterator& operator++()
+    {
+        if (++m_pos == m_end and m_line + 1 < line_count(*m_lines))
+            next_line();
+        return *this;
+    }
+
+    BasicSegmentIterator& operator--()
+    {
+        if (m_pos == line_begin())
+        {
+            --m_line;
+            set_line();
+            m_pos = m_end;
+        }
+        --m_pos;
+        return *this;
+    }
+
+    BasicSegmentIterator operator++(int)
+    {
+        BasicSegmentIterator save = *this;
+        ++*this;
+        return save;
+    }
+
+    BasicSegmentIterator operator--(int)
+    {
+        BasicSegmentIterator save = *this;
+        --*this;
+        return save;
+    }
+
+    bool operator==(const BasicSegmentIterator& other) const
+    { return m_pos == other.m_pos and m_line == other.m_line; }
+    bool operator!=(const BasicSegmentIterator& other) const
+    { return not (*this == other); }
+
+    ByteCoord coord() const { return {m_line, (int)(m_pos - line_begin())}; }
+
+    // moves to the next occurrence of literal that ends before end, or to
+    // end if there is none. literal must not contain an end of line.
+    void find(StringView literal, const BasicSegmentIterator& end)
+    {
+        kak_assert(not literal.empty());
+        const size_t length = (int)literal.length();
+        while (true)
+        {
+            const char* limit = m_line == end.m_line ? end.m_pos : m_end;
+            const char* found = limit - m_pos < (ptrdiff_t)length ? nullptr :
+                length == 1 ? (const char*)memchr(m_pos, literal[0], limit - m_pos)
+                            : (const char*)memmem(m_pos, limit - m_pos, literal.data(), length);
+            if (found)
+            {
+                m_pos = found;
+                return;
+            }
+            if (m_line == end.m_line)
+            {
+                m_pos = end.m_pos;
+                return;
+            }
+            next_line();
+        }
+    }
+
+private:
+    // the line start is not stored to keep the iterator small, as regex
+    // searches copy iterators a lot
+    const char* line_begin() const { return line_at(*m_lines, m_line, m_block).data(); }
+
+    // returns the start of the line
+    const char* set_line()
+    {
+        const StringView line = line_at(*m_lines, m_line, m_block);
+        m_end = line.data() + (int)line.length();
+        return line.data();
+    }
+
+    void next_line()
+    {
+        ++m_line;
+        m_pos = set_line();
+    }
+
+    const Lines* m_lines = nullptr;
+    LineCount   m_line = 0;
+    // block of the current line, for lines that are stored in blocks
+    mutable int m_block = 0;
+    const char* m_pos = nullptr;
+    const char* m_end = nullptr;
+};
+
+using SegmentIterator = BasicSegmentIterator<Buffer>;
+using SnapshotIterator = BasicSegmentIterator<LineList::Snapshot>;
+
+}
+
+#endif // segment_iterator_hh_INCLUDED
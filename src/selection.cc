@@ -18,6 +18,7 @@ void Selection::merge_with(const Selection& range)
 SelectionList::SelectionList(Buffer& buffer, Selection s, size_t timestamp)
     : m_buffer(&buffer), m_selections({ std::move(s) }), m_timestamp(timestamp)
 {
+    m_buffer->register_change_consumer(m_timestamp);
     check_invariant();
 }
 
@@ -29,6 +30,7 @@ SelectionList::SelectionList(Buffer& buffer, std::vector<Selection> s, size_t ti
     : m_buffer(&buffer), m_selections(std::move(s)), m_timestamp(timestamp)
 {
     kak_assert(size() > 0);
+    m_buffer->register_change_consumer(m_timestamp);
     check_invariant();
 }
 
@@ -36,6 +38,67 @@ SelectionList::SelectionList(Buffer& buffer, std::vector<Selection> s)
     : SelectionList(buffer, std::move(s), buffer.timestamp())
 {}
 
+SelectionList::SelectionList(const SelectionList& other)
+    : m_main(other.m_main), m_selections(other.m_selections),
+      m_buffer(other.m_buffer), m_timestamp(other.m_timestamp)
+{
+    if (m_buffer)
+        m_buffer->register_change_consumer(m_timestamp);
+}
+
+SelectionList::SelectionList(SelectionList&& other)
+    : m_main(other.m_main), m_selections(std::move(other.m_selections)),
+      m_timestamp(other.m_timestamp)
+{
+    if (other.m_buffer)
+    {
+        other.m_buffer->unregister_change_consumer(other.m_timestamp);
+        m_buffer = std::move(other.m_buffer);
+        m_buffer->register_change_consumer(m_timestamp);
+    }
+}
+
+SelectionList& SelectionList::operator=(const SelectionList& other)
+{
+    if (m_buffer != other.m_buffer)
+    {
+        if (m_buffer)
+            m_buffer->unregister_change_consumer(m_timestamp);
+        if (other.m_buffer)
+            other.m_buffer->register_change_consumer(m_timestamp);
+        m_buffer = other.m_buffer;
+    }
+    m_main = other.m_main;
+    m_selections = other.m_selections;
+    m_timestamp = other.m_timestamp;
+    return *this;
+}
+
+SelectionList& SelectionList::operator=(SelectionList&& other)
+{
+    if (this == &other)
+        return *this;
+
+    if (m_buffer)
+        m_buffer->unregister_change_consumer(m_timestamp);
+    if (other.m_buffer)
+    {
+        other.m_buffer->unregister_change_consumer(other.m_timestamp);
+        other.m_buffer->register_change_consumer(m_timestamp);
+    }
+    m_buffer = std::move(other.m_buffer);
+    m_main = other.m_main;
+    m_selections = std::move(other.m_selections);
+    m_timestamp = other.m_timestamp;
+    return *this;
+}
+
+SelectionList::~SelectionList()
+{
+    if (m_buffer)
+        m_buffer->unregister_change_consumer(m_timestamp);
+}
+
 namespace
 {
 
@@ -119,13 +182,6 @@ struct ForwardChangesTracker
         }
     }
 
-    void update(const Buffer& buffer, size_t& timestamp)
-    {
-        for (auto& change : buffer.changes_since(timestamp))
-            update(change);
-        timestamp = buffer.timestamp();
-    }
-
     ByteCoord get_old_coord(ByteCoord coord) const
     {
         kak_assert(cur_pos <= coord);
@@ -164,8 +220,9 @@ struct ForwardChangesTracker
     bool relevant(const Buffer::Change& change, ByteCoord old_coord) const
     {
         auto new_coord = get_new_coord_tolerant(old_coord);
-        return change.type == Buffer::Change::Insert ? change.begin <= new_coord
-                                                     : change.begin < new_coord;
+        // an erase starting at coord leaves it in place, but must be
+        // applied before a following change at the same position
+        return change.begin <= new_coord;
     }
 };
 
@@ -175,7 +232,7 @@ const Buffer::Change* forward_sorted_until(const Buffer::Change* first, const Bu
         const Buffer::Change* next = first;
         while (++next != last) {
             const auto& ref = first->type == Buffer::Change::Insert ? first->end : first->begin;
-            if (next->begin <= ref)
+            if (next->begin < ref)
                 return next;
             first = next;
         }
@@ -336,7 +393,10 @@ void SelectionList::update()
     if (m_timestamp == m_buffer->timestamp())
         return;
 
-    auto changes = m_buffer->changes_since(m_timestamp);
+    // when the changes were compacted away, selections can only be
+    // clamped to the buffer
+    auto changes = m_buffer->changes_available_since(m_timestamp) ?
+        m_buffer->changes_since(m_timestamp) : memoryview<Buffer::Change>{};
     auto change_it = changes.begin();
     while (change_it != changes.end())
     {
@@ -411,9 +471,8 @@ namespace
 inline void _avoid_eol(const Buffer& buffer, ByteCoord& coord)
 {
     const auto column = coord.column;
-    const auto& line = buffer[coord.line];
-    if (column != 0 and column == line.length() - 1)
-        coord.column = line.byte_count_to(line.char_length() - 2);
+    if (column != 0 and column == buffer[coord.line].length() - 1)
+        coord = buffer.char_prev(coord);
 }
 
 
@@ -432,32 +491,37 @@ void SelectionList::avoid_eol()
         _avoid_eol(buffer(), sel);
 }
 
-BufferIterator prepare_insert(Buffer& buffer, const Selection& sel, InsertMode mode)
+// range replaced by the content inserted for sel, in the buffer before
+// any insertion
+static Buffer::Edit insert_edit(const Buffer& buffer, const Selection& sel,
+                                InsertMode mode, StringView content)
 {
+    auto at = [&](ByteCoord coord) -> Buffer::Edit {
+        coord = buffer.iterator_at(coord).coord();
+        return { coord, coord, content };
+    };
     switch (mode)
     {
     case InsertMode::Insert:
-        return buffer.iterator_at(sel.min());
+        return at(sel.min());
     case InsertMode::InsertCursor:
-        return buffer.iterator_at(sel.cursor());
+        return at(sel.cursor());
     case InsertMode::Replace:
-        return erase(buffer, sel);
+        return { sel.min(), buffer.char_next(sel.max()), content };
     case InsertMode::Append:
     {
         // special case for end of lines, append to current line instead
         auto pos = buffer.iterator_at(sel.max());
-        return *pos == '\n' ? pos : utf8::next(pos, buffer.end());
+        return at(*pos == '\n' ? pos.coord() : utf8::next(pos, buffer.end()).coord());
     }
     case InsertMode::InsertAtLineBegin:
-        return buffer.iterator_at(sel.min().line);
+    case InsertMode::OpenLineAbove:
+        return at(sel.min().line);
     case InsertMode::AppendAtLineEnd:
-        return buffer.iterator_at({sel.max().line, buffer[sel.max().line].length() - 1});
+        return at({sel.max().line, buffer[sel.max().line].length() - 1});
     case InsertMode::InsertAtNextLineBegin:
-        return buffer.iterator_at(sel.max().line+1);
     case InsertMode::OpenLineBelow:
-        return buffer.insert(buffer.iterator_at(sel.max().line + 1), "\n");
-    case InsertMode::OpenLineAbove:
-        return buffer.insert(buffer.iterator_at(sel.min().line), "\n");
+        return at(sel.max().line+1);
     }
     kak_assert(false);
     return {};
@@ -470,42 +534,60 @@ void SelectionList::insert(memoryview<String> strings, InsertMode mode,
         return;
 
     update();
-    ForwardChangesTracker changes_tracker;
-    for (size_t index = 0; index < m_selections.size(); ++index)
-    {
-        auto& sel = m_selections[index];
-
-        sel.anchor() = changes_tracker.get_new_coord(sel.anchor());
-        kak_assert(m_buffer->is_valid(sel.anchor()));
-        sel.cursor() = changes_tracker.get_new_coord(sel.cursor());
-        kak_assert(m_buffer->is_valid(sel.cursor()));
 
-        auto pos = prepare_insert(*m_buffer, sel, mode);
-        changes_tracker.update(*m_buffer, m_timestamp);
+    // open line modes insert the content followed by the new line
+    const bool open_line = mode == InsertMode::OpenLineBelow or
+                           mode == InsertMode::OpenLineAbove;
+    std::vector<String> open_line_contents;
+    open_line_contents.reserve(open_line ? size() : 0);
 
-        const String& str = strings[std::min(index, strings.size()-1)];
-        if (str.empty())
+    std::vector<Buffer::Edit> edits;
+    edits.reserve(size());
+    for (size_t index = 0; index < m_selections.size(); ++index)
+    {
+        StringView str = strings[std::min(index, strings.size()-1)];
+        if (open_line)
         {
-            if (mode == InsertMode::Replace)
-                sel.anchor() = sel.cursor() = m_buffer->clamp(pos.coord());
-            continue;
+            open_line_contents.push_back(str + "\n");
+            str = open_line_contents.back();
         }
+        edits.push_back(insert_edit(*m_buffer, m_selections[index], mode, str));
+    }
 
-        pos = m_buffer->insert(pos, str);
+    auto ranges = m_buffer->apply_edits(edits);
+    m_timestamp = m_buffer->timestamp();
 
-        auto& change = m_buffer->changes_since(m_timestamp).back();
-        changes_tracker.update(change);
-        m_timestamp = m_buffer->timestamp();
+    // coord of the selection at index once the edits are applied, when at
+    // its insertion point it ends up after its own inserted text, not after
+    // the text inserted at the same point for the following selections.
+    auto new_coord = [&](ByteCoord coord, size_t index) {
+        auto it = std::upper_bound(edits.begin(), edits.end(), coord,
+                                   [](ByteCoord coord, const Buffer::Edit& edit)
+                                   { return coord < edit.end; });
+        if (it == edits.begin())
+            return coord;
+        const size_t last = edits[index].end == coord ? index : it - edits.begin() - 1;
+        return update_insert(coord, edits[last].end, ranges[last].second);
+    };
 
-        if (select_inserted or mode == InsertMode::Replace)
+    for (size_t index = 0; index < m_selections.size(); ++index)
+    {
+        auto& sel = m_selections[index];
+        const auto& range = ranges[index];
+        const String& str = strings[std::min(index, strings.size()-1)];
+        if (mode == InsertMode::Replace and str.empty())
+            sel.anchor() = sel.cursor() = m_buffer->clamp(range.first);
+        else if (mode == InsertMode::Replace or (select_inserted and not str.empty()))
         {
-            sel.anchor() = change.begin;
-            sel.cursor() = m_buffer->char_prev(change.end);
+            const ByteCoord end = open_line ? m_buffer->advance(range.first, str.length())
+                                            : range.second;
+            sel.anchor() = range.first;
+            sel.cursor() = m_buffer->char_prev(end);
         }
         else
         {
-            sel.anchor() = m_buffer->clamp(update_insert(sel.anchor(), change.begin, change.end));
-            sel.cursor() = m_buffer->clamp(update_insert(sel.cursor(), change.begin, change.end));
+            sel.anchor() = m_buffer->clamp(new_coord(sel.anchor(), index));
+            sel.cursor() = m_buffer->clamp(new_coord(sel.cursor(), index));
         }
     }
     check_invariant();
@@ -515,18 +597,18 @@ void SelectionList::insert(memoryview<String> strings, InsertMode mode,
 void SelectionList::erase()
 {
     update();
-    ForwardChangesTracker changes_tracker;
+
+    std::vector<Buffer::Edit> edits;
+    edits.reserve(size());
     for (auto& sel : m_selections)
-    {
-        sel.anchor() = changes_tracker.get_new_coord(sel.anchor());
-        kak_assert(m_buffer->is_valid(sel.anchor()));
-        sel.cursor() = changes_tracker.get_new_coord(sel.cursor());
-        kak_assert(m_buffer->is_valid(sel.cursor()));
-
-        auto pos = Kakoune::erase(*m_buffer, sel);
-        sel.anchor() = sel.cursor() = m_buffer->clamp(pos.coord());
-        changes_tracker.update(*m_buffer, m_timestamp);
-    }
+        edits.push_back({ sel.min(), m_buffer->char_next(sel.max()), {} });
+
+    auto ranges = m_buffer->apply_edits(edits);
+    for (size_t index = 0; index < m_selections.size(); ++index)
+        m_selections[index].anchor() = m_selections[index].cursor() =
+            m_buffer->clamp(ranges[index].first);
+    m_timestamp = m_buffer->timestamp();
+
     m_buffer->check_invariant();
 }
 
@@ -73,6 +73,13 @@ struct SelectionList
     SelectionList(Buffer& buffer, std::vector<Selection> s);
     SelectionList(Buffer& buffer, std::vector<Selection> s, size_t timestamp);
 
+    // selection lists register their timestamp as a change consumer
+    SelectionList(const SelectionList& other);
+    SelectionList(SelectionList&& other);
+    SelectionList& operator=(const SelectionList& other);
+    SelectionList& operator=(SelectionList&& other);
+    ~SelectionList();
+
     void update();
 
     void check_invariant() const;
@@ -494,60 +494,205 @@ void select_buffer(SelectionList& selections)
     selections = SelectionList{ buffer, target_eol({{0,0}, buffer.back_coord()}) };
 }
 
-void select_all_matches(SelectionList& selections, const Regex& regex)
+// a regex match, with its captures when requested
+struct FoundMatch
 {
-    std::vector<Selection> result;
-    auto& buffer = selections.buffer();
-    for (auto& sel : selections)
+    ByteCoord begin;
+    ByteCoord end;
+    CaptureList captures;
+};
+
+template<typename Iterator>
+static FoundMatch make_found_match(const boost::match_results<Iterator>& results,
+                                   bool with_captures)
+{
+    FoundMatch match{results[0].first.coord(), results[0].second.coord(), {}};
+    if (with_captures)
     {
-        auto sel_end = utf8::next(buffer.iterator_at(sel.max()), buffer.end());
-        RegexIterator re_it(buffer.iterator_at(sel.min()), sel_end, regex);
-        RegexIterator re_end;
+        for (auto& sub : results)
+            match.captures.emplace_back(sub.first, sub.second);
+    }
+    return match;
+}
 
-        for (; re_it != re_end; ++re_it)
-        {
-            auto& begin = (*re_it)[0].first;
-            auto& end   = (*re_it)[0].second;
+// calls func on the matches of regex starting from pos to limit, as a
+// RegexIterator on [base, end) finds them, until it returns false.
+// after_empty tells if the previous match was an empty one ending at pos.
+template<typename Iterator, typename Func>
+static void for_each_match(Iterator pos, const Iterator& limit, const Iterator& end,
+                           const Iterator& base, const Regex& regex, StringView prefix,
+                           RegexFlags flags, bool after_empty, Func func)
+{
+    boost::match_results<Iterator> results;
+    while (find_first_match_before(pos, limit, end, results, regex, prefix,
+                                   after_empty ? flags | boost::regex_constants::match_not_initial_null
+                                               : flags, base))
+    {
+        if (not func(results))
+            return;
+        pos = results[0].second;
+        after_empty = results[0].first == results[0].second;
+    }
+}
+
+// calls func on the matches of regex in [begin, end), in order.
+//
+// Ranges of at least chunk_size bytes are cut in line aligned chunks
+// searched in parallel, on up to max_threads threads, on a snapshot of
+// the buffer. A chunk search finds the matches starting in the chunk,
+// which can go on past its end. As it does not start where the previous
+// chunk matches ended, the chunks are then merged: a chunk matches are
+// taken as they are when the whole search goes on at the chunk start,
+// otherwise the matches following the previous chunk ones are searched on
+// the buffer until one is also a chunk match, from which the chunk
+// matches are the expected ones.
+template<typename Func>
+static void find_all_matches(const Buffer& buffer, ByteCoord begin, ByteCoord end,
+                             const Regex& regex, RegexFlags flags, bool with_captures,
+                             size_t chunk_size, unsigned max_threads, Func func)
+{
+    const String prefix = literal_prefix(regex);
+    const SegmentIterator base{buffer, begin};
+    const SegmentIterator end_it{buffer, end};
+
+    const ByteCount begin_offset = buffer.byte_offset(begin);
+    const size_t size = (int)(buffer.byte_offset(end) - begin_offset);
+    const size_t max_chunk_count = parallel_thread_count(size, chunk_size, 8);
+    if (max_chunk_count == 1)
+    {
+        for_each_match(base, end_it, end_it, base, regex, prefix, flags, false,
+                       [&](const MatchResults& results) {
+                           func(make_found_match(results, with_captures));
+                           return true;
+                       });
+        return;
+    }
 
-            if (begin == sel_end)
-                continue;
+    // chunk i is [chunk_begins[i], chunk_begins[i+1])
+    std::vector<ByteCoord> chunk_begins{begin};
+    for (size_t i = 1; i < max_chunk_count; ++i)
+    {
+        ByteCoord chunk_begin{buffer.coord_at_byte_offset(begin_offset + (int)(size * i / max_chunk_count)).line, 0};
+        if (chunk_begins.back() < chunk_begin and chunk_begin < end)
+            chunk_begins.push_back(chunk_begin);
+    }
+    chunk_begins.push_back(end);
+    const size_t chunk_count = chunk_begins.size() - 1;
+
+    std::vector<std::vector<FoundMatch>> chunk_matches(chunk_count);
+    auto snapshot = buffer.snapshot();
+    run_parallel(chunk_count, [&](size_t i) {
+        const auto& lines = snapshot->lines;
+        for_each_match(SnapshotIterator{lines, chunk_begins[i]},
+                       SnapshotIterator{lines, chunk_begins[i+1]},
+                       SnapshotIterator{lines, end}, SnapshotIterator{lines, begin},
+                       regex, prefix, flags, false,
+                       [&](const boost::match_results<SnapshotIterator>& results) {
+                           chunk_matches[i].push_back(make_found_match(results, with_captures));
+                           return true;
+                       });
+    }, max_threads);
+
+    // where the whole search goes on after the merged matches
+    SegmentIterator pos = base;
+    bool after_empty = false;
+    auto merge = [&](FoundMatch&& match) {
+        pos = SegmentIterator{buffer, match.end};
+        after_empty = match.begin == match.end;
+        func(std::move(match));
+    };
+    for (size_t i = 0; i < chunk_count; ++i)
+    {
+        auto& matches = chunk_matches[i];
+        const SegmentIterator chunk_end{buffer, chunk_begins[i+1]};
+        if (pos.coord() == chunk_begins[i] and not after_empty)
+        {
+            // the chunk search is the same as the whole one
+            for (auto& match : matches)
+                merge(std::move(match));
+        }
+        else
+        {
+            auto it = matches.begin();
+            while (true)
+            {
+                Optional<FoundMatch> next;
+                for_each_match(pos, chunk_end, end_it, base, regex, prefix, flags, after_empty,
+                               [&](const MatchResults& results) {
+                                   next = make_found_match(results, with_captures);
+                                   return false;
+                               });
+                if (not next)
+                    break;
 
-            CaptureList captures;
-            for (auto& match : *re_it)
-                captures.emplace_back(match.first, match.second);
+                while (it != matches.end() and it->begin < next->begin)
+                    ++it;
+                if (it != matches.end() and it->begin == next->begin and it->end == next->end)
+                {
+                    // the chunk search reached the same match, it finds the
+                    // same ones after it
+                    for (; it != matches.end(); ++it)
+                        merge(std::move(*it));
+                    break;
+                }
+                merge(std::move(*next));
+            }
+        }
 
-            result.push_back(
-                keep_direction({ begin.coord(),
-                                 (begin == end ? end : utf8::previous(end, begin)).coord(),
-                                 std::move(captures) }, sel));
+        // no other match starts before the chunk end, the whole search
+        // can go on from there
+        if (pos.coord() < chunk_begins[i+1])
+        {
+            pos = chunk_end;
+            after_empty = false;
         }
     }
+}
+
+void select_all_matches(SelectionList& selections, const Regex& regex,
+                        size_t chunk_size, unsigned max_threads)
+{
+    std::vector<Selection> result;
+    auto& buffer = selections.buffer();
+    const SegmentIterator buffer_end{buffer, buffer.end_coord()};
+    for (auto& sel : selections)
+    {
+        const ByteCoord sel_end = utf8::next(SegmentIterator{buffer, sel.max()}, buffer_end).coord();
+        find_all_matches(buffer, sel.min(), sel_end, regex, boost::match_default, true,
+                         chunk_size, max_threads, [&](FoundMatch&& match) {
+                             if (match.begin == sel_end)
+                                 return;
+
+                             const ByteCoord end = match.begin == match.end ?
+                                 match.end : buffer.char_prev(match.end);
+                             result.push_back(keep_direction(
+                                 { match.begin, end, std::move(match.captures) }, sel));
+                         });
+    }
     if (result.empty())
         throw runtime_error("nothing selected");
     selections = std::move(result);
 }
 
-void split_selections(SelectionList& selections, const Regex& regex)
+void split_selections(SelectionList& selections, const Regex& regex,
+                      size_t chunk_size, unsigned max_threads)
 {
     std::vector<Selection> result;
     auto& buffer = selections.buffer();
+    const SegmentIterator buffer_end{buffer, buffer.end_coord()};
     for (auto& sel : selections)
     {
-        auto begin = buffer.iterator_at(sel.min());
-        auto sel_end = utf8::next(buffer.iterator_at(sel.max()), buffer.end());
-        RegexIterator re_it(begin, sel_end, regex,
-                            boost::regex_constants::match_nosubs);
-        RegexIterator re_end;
-
-        for (; re_it != re_end; ++re_it)
-        {
-            BufferIterator end = (*re_it)[0].first;
-
-            result.push_back(keep_direction({ begin.coord(), (begin == end) ? end.coord() : utf8::previous(end, begin).coord() }, sel));
-            begin = (*re_it)[0].second;
-        }
-        if (begin.coord() <= sel.max())
-            result.push_back(keep_direction({ begin.coord(), sel.max() }, sel));
+        ByteCoord begin = SegmentIterator{buffer, sel.min()}.coord();
+        const ByteCoord sel_end = utf8::next(SegmentIterator{buffer, sel.max()}, buffer_end).coord();
+        find_all_matches(buffer, begin, sel_end, regex, boost::regex_constants::match_nosubs, false,
+                         chunk_size, max_threads, [&](FoundMatch&& match) {
+                             const ByteCoord end = (begin == match.begin) ?
+                                 match.begin : buffer.char_prev(match.begin);
+                             result.push_back(keep_direction({ begin, end }, sel));
+                             begin = match.end;
+                         });
+        if (begin <= sel.max())
+            result.push_back(keep_direction({ begin, sel.max() }, sel));
     }
     selections = std::move(result);
 }
@@ -3,6 +3,8 @@
 
 #include "selection.hh"
 #include "buffer_utils.hh"
+#include "regex_search.hh"
+#include "search_index.hh"
 #include "unicode.hh"
 #include "utf8_iterator.hh"
 
@@ -59,8 +61,6 @@ inline Selection utf8_range(const Utf8Iterator& first, const Utf8Iterator& last)
     return {first.base().coord(), last.base().coord()};
 }
 
-using RegexIterator = boost::regex_iterator<BufferIterator>;
-
 template<WordType word_type>
 Selection select_to_next_word(const Buffer& buffer, const Selection& selection)
 {
@@ -230,51 +230,97 @@ void select_buffer(SelectionList& selections);
 
 enum Direction { Forward, Backward };
 
-using MatchResults = boost::match_results<BufferIterator>;
-
-inline bool find_last_match(BufferIterator begin, const BufferIterator& end,
-                            MatchResults& res, const Regex& regex)
+// finds the last match of regex in [begin, end), iterating over its
+// matches from begin until an empty one. boost regexes can only match
+// forward, so when regex cannot span lines, the lines before end are
+// searched from a line start going back from end, doubling the number of
+// searched lines until a match is found: the matches from begin do not go
+// over a line start, so they are the same as the ones found from there.
+// Each of these searches stops at the start of the lines searched by the
+// previous one, so the cost is proportional to the distance from end to
+// the last match instead of the distance from begin to end. Other regexes,
+// and the ones having empty matches in the searched lines, are searched
+// from begin. An empty match only found before these lines is missed.
+inline bool find_last_match(const Buffer& buffer, const SegmentIterator& begin,
+                            const SegmentIterator& end, MatchResults& res,
+                            const Regex& regex)
 {
-    MatchResults matches;
-    while (boost::regex_search(begin, end, matches, regex))
+    const String prefix = literal_prefix(regex);
+    // finds the last match starting before limit, a line start, returns
+    // false if an empty match was found
+    auto find_last_from = [&](SegmentIterator pos, const SegmentIterator& limit,
+                              MatchResults& last) {
+        MatchResults matches;
+        while (find_first_match_before(pos, limit, end, matches, regex, prefix,
+                                       boost::match_default, begin))
+        {
+            if (pos == matches[0].second)
+                return false;
+            pos = matches[0].second;
+            last.swap(matches);
+        }
+        return true;
+    };
+
+    const LineCount begin_line = begin.coord().line;
+    LineCount line = end.coord().line;
+    LineCount line_count = 1;
+    SegmentIterator limit = end;
+    if (not may_span_lines(regex))
     {
-        if (begin == matches[0].second)
-            break;
-        begin = matches[0].second;
-        res.swap(matches);
+        for (; line > begin_line; line -= line_count, line_count *= 2)
+        {
+            const SegmentIterator line_begin{buffer, {line, 0}};
+            MatchResults last;
+            if (not find_last_from(line_begin, limit, last))
+            {
+                limit = end;
+                break;
+            }
+            if (not last.empty())
+            {
+                res.swap(last);
+                return true;
+            }
+            limit = line_begin;
+        }
     }
+    find_last_from(begin, limit, res);
     return not res.empty();
 }
 
 template<Direction direction>
-bool find_match_in_buffer(const Buffer& buffer, const BufferIterator pos,
+bool find_match_in_buffer(const Buffer& buffer, const SegmentIterator pos,
                           MatchResults& matches, const Regex& ex)
 {
+    const SegmentIterator begin{buffer, {0,0}};
+    const SegmentIterator end{buffer, buffer.end_coord()};
     if (direction == Forward)
-        return (boost::regex_search(pos, buffer.end(), matches, ex) or
-                boost::regex_search(buffer.begin(), buffer.end(), matches, ex));
+        return (find_first_match(pos, end, matches, ex) or
+                find_first_match(begin, end, matches, ex));
     else
-        return (find_last_match(buffer.begin(), pos, matches, ex) or
-                find_last_match(buffer.begin(), buffer.end(), matches, ex));
+        return (find_last_match(buffer, begin, pos, matches, ex) or
+                find_last_match(buffer, begin, end, matches, ex));
 }
 
 template<Direction direction>
 Selection find_next_match(const Buffer& buffer, const Selection& sel, const Regex& regex)
 {
-    auto begin = buffer.iterator_at(direction == Backward ? sel.min() : sel.max());
+    const SegmentIterator buffer_end{buffer, buffer.end_coord()};
+    SegmentIterator begin{buffer, direction == Backward ? sel.min() : sel.max()};
     auto end = begin;
 
     CaptureList captures;
     MatchResults matches;
     bool found = false;
-    if ((found = find_match_in_buffer<direction>(buffer, utf8::next(begin, buffer.end()), matches, regex)))
+    if ((found = find_match_in_buffer<direction>(buffer, utf8::next(begin, buffer_end), matches, regex)))
     {
         begin = matches[0].first;
         end   = matches[0].second;
         for (auto& match : matches)
             captures.emplace_back(match.first, match.second);
     }
-    if (not found or begin == buffer.end())
+    if (not found or begin == buffer_end)
         throw runtime_error("'" + regex.str() + "': no matches found");
 
     end = (begin == end) ? end : utf8::previous(end, begin);
@@ -284,11 +330,82 @@ Selection find_next_match(const Buffer& buffer, const Selection& sel, const Rege
     return {begin.coord(), end.coord(), std::move(captures)};
 }
 
+// same as find_next_match with the index regex. The index matches are the
+// ones found from the buffer start, the regex is searched from the selection
+// instead when that can find other matches: when the search starts inside
+// a match, when the regex looks before its start going forward, or going
+// backward when it looks after its end or has empty matches, which stop
+// the backward search.
+template<Direction direction>
+Selection find_next_match(const Buffer& buffer, const Selection& sel, const SearchIndex& index)
+{
+    using namespace boost::regex_constants;
+    auto& matches = index.matches();
+    const ByteCoord buffer_end = buffer.end_coord();
+    const ByteCoord pos = buffer.char_next(direction == Forward ? sel.max() : sel.min());
+    if (index.inside_match(pos) or
+        (direction == Forward ? has_lookbehind(index.regex())
+                              : has_lookahead(index.regex()) or index.has_empty_matches()))
+        return find_next_match<direction>(buffer, sel, index.regex());
+
+    const SearchIndex::Match* match = nullptr;
+    if (not matches.empty())
+        match = &matches[direction == Forward ? index.next(pos) : index.previous(pos)];
+
+    MatchResults results;
+    bool matched = false;
+    if (direction == Forward)
+    {
+        // a search from pos sees it as the start of the text, which can
+        // change the matches starting there
+        const SegmentIterator pos_it{buffer, pos};
+        matched = find_first_match(pos_it, SegmentIterator{buffer, buffer_end}, results,
+                                   index.regex(), StringView{}, match_continuous, pos_it);
+        if (matched != (match and match->begin == pos) or
+            (matched and results[0].second.coord() != match->end))
+            return find_next_match<direction>(buffer, sel, index.regex());
+    }
+    if (not match or match->begin == buffer_end)
+        throw runtime_error("'" + index.regex().str() + "': no matches found");
+
+    // the index only knows where matches are, match again for the captures
+    ByteCoord begin = match->begin;
+    ByteCoord end   = match->end;
+    if (not matched)
+        matched = find_first_match(SegmentIterator{buffer, begin}, SegmentIterator{buffer, buffer_end},
+                                   results, index.regex(), StringView{},
+                                   begin == end ? match_continuous : match_continuous | match_not_initial_null,
+                                   SegmentIterator{buffer, {0,0}});
+    CaptureList captures;
+    if (matched)
+    {
+        end = results[0].second.coord();
+        for (auto& sub : results)
+            captures.emplace_back(sub.first, sub.second);
+    }
+
+    end = (begin == end) ? end : buffer.char_prev(end);
+    if (direction == Backward)
+        std::swap(begin, end);
+
+    return {begin, end, std::move(captures)};
+}
+
+// below that size, a selection is searched on a single thread
+constexpr size_t parallel_search_size = 1024 * 1024;
+
+// selections of at least chunk_size bytes are cut in up to 8 chunks
+// searched in parallel on up to max_threads threads, or one per core
+// when 0.
 void select_all_matches(SelectionList& selections,
-                        const Regex& regex);
+                        const Regex& regex,
+                        size_t chunk_size = parallel_search_size,
+                        unsigned max_threads = 0);
 
 void split_selections(SelectionList& selections,
-                      const Regex& separator_regex);
+                      const Regex& separator_regex,
+                      size_t chunk_size = parallel_search_size,
+                      unsigned max_threads = 0);
 
 using CodepointPair = std::pair<Codepoint, Codepoint>;
 Selection select_surrounding(const Buffer& buffer, const Selection& selection,
@@ -2,6 +2,7 @@
 
 #include "context.hh"
 #include "debug.hh"
+#include "file.hh"
 
 #include <cstring>
 #include <sys/types.h>
@@ -48,22 +49,17 @@ String ShellManager::pipe(StringView input,
         write(write_pipe[1], input.data(), (int)input.length());
         close(write_pipe[1]);
 
-        char buffer[1024];
-        while (size_t size = read(read_pipe[0], buffer, 1024))
+        String errorout;
+        try
         {
-            if (size == -1)
-                break;
-            output += String(buffer, buffer+size);
+            output = read_fd(read_pipe[0]);
+            errorout = read_fd(error_pipe[0]);
         }
-        close(read_pipe[0]);
-
-        String errorout;
-        while (size_t size = read(error_pipe[0], buffer, 1024))
+        catch (runtime_error& e)
         {
-            if (size == -1)
-                break;
-            errorout += String(buffer, buffer+size);
+            errorout = e.what();
         }
+        close(read_pipe[0]);
         close(error_pipe[0]);
         if (not errorout.empty())
             write_debug("shell stderr: <<<\n" + errorout + ">>>");
@@ -0,0 +1,150 @@
+#include "undo_store.hh"
+
+#include "exception.hh"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+namespace Kakoune
+{
+
+struct UndoStore::Payload
+{
+    Payload(UndoStore& store, String content)
+        : store(store), data(std::move(content)), length(data.length())
+    {
+        store.m_memory += (int)length;
+    }
+
+    ~Payload()
+    {
+        if (loaded)
+            store.m_memory -= (int)length;
+    }
+
+    UndoStore& store;
+    String     data;
+    ByteCount  length;
+    bool       loaded = true;
+    // position in the spill file, once written there
+    off_t      offset = -1;
+};
+
+ByteCount UndoStore::Content::length() const
+{
+    return m_payload ? m_payload->length : 0;
+}
+
+UndoStore::~UndoStore()
+{
+    if (m_spill_fd != -1)
+        close(m_spill_fd);
+}
+
+UndoStore::Content UndoStore::store(String content)
+{
+    Content res;
+    res.m_payload = std::make_shared<Payload>(*this, std::move(content));
+    return res;
+}
+
+bool UndoStore::can_append(const Content& content) const
+{
+    return content.m_payload and content.m_payload.use_count() == 1 and
+           content.m_payload->loaded;
+}
+
+bool UndoStore::append(Content& content, StringView text)
+{
+    if (not can_append(content))
+        return false;
+
+    Payload* payload = content.m_payload.get();
+
+    payload->data.append(text.data(), (int)text.length());
+    payload->length += text.length();
+    m_memory += (int)text.length();
+    // the spill file copy is outdated
+    payload->offset = -1;
+    return true;
+}
+
+StringView UndoStore::get(const Content& content)
+{
+    Payload* payload = content.m_payload.get();
+    if (not payload)
+        return {};
+    if (payload->loaded)
+        return payload->data;
+
+    String data;
+    data.resize((int)payload->length);
+    for (ByteCount pos = 0; pos != payload->length; )
+    {
+        ssize_t count = pread(m_spill_fd, &data[pos], (int)(payload->length - pos),
+                              payload->offset + (int)pos);
+        if (count < 0 and errno == EINTR)
+            continue;
+        // the file was truncated behind our back when count is 0
+        if (count <= 0)
+            throw runtime_error("unable to read back undo data");
+        pos += (int)count;
+    }
+    payload->data = std::move(data);
+    payload->loaded = true;
+    m_memory += (int)payload->length;
+    return payload->data;
+}
+
+bool UndoStore::spill(const Content& content)
+{
+    Payload* payload = content.m_payload.get();
+    if (not payload or not payload->loaded or payload->length == 0)
+        return true;
+
+    // content read back from the file is still there
+    if (payload->offset == -1)
+    {
+        if (not open_spill_file())
+            return false;
+
+        const char* data = payload->data.data();
+        for (ByteCount pos = 0; pos != payload->length; )
+        {
+            ssize_t count = pwrite(m_spill_fd, data + (int)pos, (int)(payload->length - pos),
+                                   m_spill_size + (int)pos);
+            if (count < 0 and errno == EINTR)
+                continue;
+            if (count <= 0)
+                return false;
+            pos += (int)count;
+        }
+        payload->offset = m_spill_size;
+        m_spill_size += (int)payload->length;
+    }
+
+    String{}.swap(payload->data);
+    payload->loaded = false;
+    m_memory -= (int)payload->length;
+    return true;
+}
+
+bool UndoStore::open_spill_file()
+{
+    if (m_spill_fd != -1)
+        return true;
+
+    const char* tmpdir = getenv("TMPDIR");
+    String path = String{tmpdir ? tmpdir : "/tmp"} + "/kak-undo-XXXXXX";
+    m_spill_fd = mkstemp(&path[0_byte]);
+    if (m_spill_fd == -1)
+        return false;
+    // the file is only reachable through our descriptor
+    unlink(path.c_str());
+    fcntl(m_spill_fd, F_SETFD, FD_CLOEXEC);
+    return true;
+}
+
+}
@@ -0,0 +1,63 @@
+#ifndef undo_store_hh_INCLUDED
+#define undo_store_hh_INCLUDED
+
+#include "string.hh"
+
+#include <memory>
+
+namespace Kakoune
+{
+
+// Holds the text of undo modifications. Payloads are reference counted
+// so that a modification and its inverse share them, and are not interned.
+// Payloads can be spilled to an append only temporary file to release
+// their memory, they are read back when accessed.
+class UndoStore
+{
+    struct Payload;
+public:
+    class Content
+    {
+    public:
+        ByteCount length() const;
+
+    private:
+        friend class UndoStore;
+        std::shared_ptr<Payload> m_payload;
+    };
+
+    UndoStore() = default;
+    ~UndoStore();
+    UndoStore(const UndoStore&) = delete;
+    UndoStore& operator=(const UndoStore&) = delete;
+
+    Content store(String content);
+    // appends text to content, returns false if content is shared, as
+    // other holders expect it to be immutable
+    bool append(Content& content, StringView text);
+    bool can_append(const Content& content) const;
+
+    // returns the content text, reading it back from the spill file if
+    // needed. Stays valid until the content is spilled again.
+    StringView get(const Content& content);
+
+    // writes content to the spill file and releases its memory, returns
+    // false if the spill file could not be written
+    bool spill(const Content& content);
+
+    // bytes of payload held in memory
+    size_t memory() const { return m_memory; }
+    // bytes written to the spill file
+    size_t spilled() const { return m_spill_size; }
+
+private:
+    bool open_spill_file();
+
+    size_t m_memory = 0;
+    int    m_spill_fd = -1;
+    size_t m_spill_size = 0;
+};
+
+}
+
+#endif // undo_store_hh_INCLUDED
@@ -1,7 +1,11 @@
 #include "assert.hh"
 #include "buffer.hh"
+#include "diff.hh"
 #include "keys.hh"
+#include "line_modification.hh"
+#include "search_index.hh"
 #include "selectors.hh"
+#include "undo_store.hh"
 #include "word_db.hh"
 
 using namespace Kakoune;
@@ -29,6 +33,11 @@ void test_buffer()
     pos2 -= 9;
     kak_assert(*pos2 == '?');
 
+    kak_assert(buffer.byte_offset({2, 3}) == 7 + 13 + 3);
+    kak_assert(buffer.coord_at_byte_offset(7 + 13 + 3) == ByteCoord{2 COMMA 3});
+    kak_assert(buffer.coord_at_byte_offset(7) == ByteCoord{1 COMMA 0});
+    kak_assert(buffer.coord_at_byte_offset(1000) == buffer.end_coord());
+
     String str = buffer.string({ 4, 1 }, buffer.next({ 4, 5 }));
     kak_assert(str == "youpi");
 
@@ -49,6 +58,193 @@ void test_buffer()
     kak_assert(buffer.string(buffer.advance(buffer.end_coord(), -7), buffer.end_coord()) == "kanaky\n");
     buffer.redo();
     kak_assert(buffer.string(buffer.advance(buffer.end_coord(), -6), buffer.end_coord()) == "mutch\n");
+
+    // segment iterators walk the same bytes as buffer iterators
+    SegmentIterator seg{buffer, {0,0}};
+    const SegmentIterator seg_end{buffer, buffer.end_coord()};
+    for (auto it = buffer.begin(); it != buffer.end(); ++it, ++seg)
+        kak_assert(seg != seg_end and *seg == *it and seg.coord() == it.coord());
+    kak_assert(seg == seg_end and (--seg).coord() == buffer.back_coord());
+    kak_assert((SegmentIterator{buffer, {1, 0}}--).coord() == ByteCoord{1 COMMA 0});
+    kak_assert((--SegmentIterator{buffer, {1, 0}}).coord() == ByteCoord{0 COMMA 6});
+
+    MatchResults matches;
+    kak_assert(boost::regex_search(SegmentIterator{buffer, {0,0}}, seg_end, matches, Regex{"\\?\\n\\w+"}));
+    kak_assert(matches[0].first.coord() == ByteCoord{0 COMMA 5} and
+               matches[0].second.coord() == ByteCoord{1 COMMA 5});
+}
+
+void test_regex_search()
+{
+    kak_assert(literal_prefix(Regex{"\\bTODO\\b"}) == "TODO");
+    kak_assert(literal_prefix(Regex{"ab*"}) == "a");
+    kak_assert(literal_prefix(Regex{"ab+c"}) == "ab");
+    kak_assert(literal_prefix(Regex{"a|b"}).empty());
+    kak_assert(literal_prefix(Regex{"\\<foo\\>"}) == "foo");
+    kak_assert(literal_prefix(Regex{"\\`foo\\'"}) == "foo");
+    kak_assert(not may_span_lines(Regex{"\\<fo+\\.\\w[a-z]$"}));
+    for (auto regex : { "a\\nb", "\\s", "[^a]", "a\\Sb" })
+        kak_assert(may_span_lines(Regex{regex}));
+
+    Buffer buffer("test", Buffer::Flags::None, { "foo bar\n", "barbar foobar\n", "foo\n" });
+    const SegmentIterator begin{buffer, {0,0}};
+    const SegmentIterator end{buffer, buffer.end_coord()};
+    MatchResults matches;
+    kak_assert(find_first_match(begin, end, matches, Regex{"\\bbar\\b"}));
+    kak_assert(matches[0].first.coord() == ByteCoord{0 COMMA 4});
+    kak_assert(find_first_match(SegmentIterator{buffer, {0,5}}, end, matches, Regex{"\\bbar"}));
+    kak_assert(matches[0].first.coord() == ByteCoord{1 COMMA 0});
+    kak_assert(find_first_match(begin, end, matches, Regex{"o\\n"}));
+    kak_assert(matches[0].first.coord() == ByteCoord{2 COMMA 2});
+    kak_assert(not find_first_match(begin, end, matches, Regex{"oo\\s+f"}));
+    kak_assert(find_first_match(begin, end, matches, Regex{"foo\\>"}));
+    kak_assert(matches[0].first.coord() == ByteCoord{0 COMMA 0});
+    kak_assert(find_first_match(begin, end, matches, Regex{"o\\>"}));
+    kak_assert(matches[0].first.coord() == ByteCoord{0 COMMA 2});
+    kak_assert(find_first_match(SegmentIterator{buffer, {0,1}}, end, matches, Regex{"\\<foo\\>"}));
+    kak_assert(matches[0].first.coord() == ByteCoord{2 COMMA 0});
+    kak_assert(find_first_match(begin, end, matches, Regex{"\\`foo"}));
+    kak_assert(matches[0].first.coord() == ByteCoord{0 COMMA 0});
+
+    std::vector<ByteCoord> found;
+    for (RegexIterator it{begin, end, Regex{"foo"}}, it_end; it != it_end; ++it)
+        found.push_back((*it)[0].first.coord());
+    kak_assert(found == std::vector<ByteCoord>({{0,0}, {1,7}, {2,0}}));
+
+    std::vector<String> lines(100, "line\n");
+    lines[3] = "foo\n";
+    Buffer long_buffer("long", Buffer::Flags::None, lines);
+    auto previous = [&](ByteCoord coord, const char* regex) {
+        return find_next_match<Backward>(long_buffer, Selection{coord, coord}, Regex{regex});
+    };
+    Selection sel = previous({90,0}, "foo");
+    kak_assert(sel.min() == ByteCoord{3 COMMA 0} and sel.max() == ByteCoord{3 COMMA 2});
+    sel = previous({90,0}, "o\\nl");
+    kak_assert(sel.min() == ByteCoord{3 COMMA 2} and sel.max() == ByteCoord{4 COMMA 0});
+    sel = previous({2,0}, "foo");
+    kak_assert(sel.min() == ByteCoord{3 COMMA 0});
+    sel = previous({90,0}, "^line");
+    kak_assert(sel.min() == ByteCoord{89 COMMA 0});
+
+    // a match going over several searched chunks is not cut at their start
+    std::vector<String> pairs;
+    for (int i = 0; i < 10; ++i)
+    {
+        pairs.push_back("a\n");
+        pairs.push_back("b\n");
+    }
+    pairs.push_back("zz\n");
+    Buffer pairs_buffer("pairs", Buffer::Flags::None, pairs);
+    sel = find_next_match<Backward>(pairs_buffer, Selection{{20,1}, {20,1}}, Regex{"(a\\nb\\n)+"});
+    kak_assert(sel.min() == ByteCoord{0 COMMA 0} and sel.max() == ByteCoord{19 COMMA 1});
+    sel = find_next_match<Backward>(pairs_buffer, Selection{{20,1}, {20,1}}, Regex{"b\\na"});
+    kak_assert(sel.min() == ByteCoord{17 COMMA 0} and sel.max() == ByteCoord{18 COMMA 0});
+    // overlapping candidates, searching from a later line start finds the
+    // other ones
+    Buffer overlaps("overlaps", Buffer::Flags::None, { "xy\n", "yx\n", "x\n", "x\n", "x\n", "xy\n", "yx\n" });
+    sel = find_next_match<Backward>(overlaps, Selection{{5,1}, {5,1}}, Regex{"x\nx"});
+    kak_assert(sel.min() == ByteCoord{3 COMMA 0} and sel.max() == ByteCoord{4 COMMA 0});
+    sel = find_next_match<Backward>(overlaps, Selection{{6,1}, {6,1}}, Regex{"x\n(x\n)*"});
+    kak_assert(sel.min() == ByteCoord{1 COMMA 1} and sel.max() == ByteCoord{4 COMMA 1});
+
+    SelectionList sels{buffer, Selection{{0,0}, buffer.back_coord()}};
+    select_all_matches(sels, Regex{"(\\w)o+"});
+    kak_assert(sels.size() == 3 and sels[1].min() == ByteCoord{1 COMMA 7} and
+               sels[1].max() == ByteCoord{1 COMMA 9} and sels[1].captures()[1] == "f");
+    sels = SelectionList{buffer, Selection{{0,0}, buffer.back_coord()}};
+    split_selections(sels, Regex{"\\s+"});
+    kak_assert(sels.size() == 5 and sels[3].min() == ByteCoord{1 COMMA 7} and
+               sels[3].max() == ByteCoord{1 COMMA 12});
+
+    // searching in several chunks finds the same matches as a single search,
+    // including the ones crossing chunk ends
+    Buffer chunk_buffer("chunks", Buffer::Flags::None,
+                        { "ab\n", "ab ab\n", "\n", "b\n", "a\n", "bab\n", "ab\n", "a\n", "b\n",
+                          "ab\n", "ab ab\n", "\n", "b\n", "a\n" });
+    auto same_selections = [](const SelectionList& lhs, const SelectionList& rhs) {
+        if (lhs.size() != rhs.size())
+            return false;
+        for (size_t i = 0; i < lhs.size(); ++i)
+        {
+            if (lhs[i].anchor() != rhs[i].anchor() or lhs[i].cursor() != rhs[i].cursor() or
+                lhs[i].captures() != rhs[i].captures())
+                return false;
+        }
+        return true;
+    };
+    const Selection whole{{0,0}, chunk_buffer.back_coord()};
+    for (auto regex : { "(ab\\n)+", "a*" })
+    {
+        const Regex ex{regex};
+        SelectionList single{chunk_buffer, whole}, chunked{chunk_buffer, whole};
+        select_all_matches(single, ex, parallel_search_size, 1);
+        select_all_matches(chunked, ex, 6, 1);
+        kak_assert(same_selections(single, chunked));
+    }
+    SelectionList single{chunk_buffer, whole}, chunked{chunk_buffer, whole};
+    split_selections(single, Regex{"\\s+"}, parallel_search_size, 1);
+    split_selections(chunked, Regex{"\\s+"}, 6, 1);
+    kak_assert(same_selections(single, chunked));
+}
+
+void test_search_index()
+{
+    Buffer buffer("test", Buffer::Flags::None, { "foo bar\n", "barbar foobar\n", "foo\n" });
+    auto check = [&](StringView regex) {
+        const SearchIndex* index = SearchIndex::get(buffer, regex);
+        std::vector<SearchIndex::Match> expected;
+        for (RegexIterator it{SegmentIterator{buffer, {0,0}}, SegmentIterator{buffer, buffer.end_coord()},
+                              index->regex()}, end; it != end; ++it)
+            expected.push_back({(*it)[0].first.coord(), (*it)[0].second.coord()});
+        kak_assert(index->matches().size() == expected.size());
+        for (size_t i = 0; i < expected.size(); ++i)
+            kak_assert(index->matches()[i].begin == expected[i].begin and
+                       index->matches()[i].end == expected[i].end);
+        return index->matches().size();
+    };
+
+    kak_assert(check("bar") == 4);
+    const SearchIndex* index = SearchIndex::get(buffer, "bar");
+    kak_assert(index->next({0,4}) == 0 and index->next({0,5}) == 1 and index->next({2,0}) == 0);
+    kak_assert(index->previous({0,4}) == 3 and index->previous({1,6}) == 2);
+    kak_assert(index->count_until({0,3}) == 0 and index->count_until({1,3}) == 3);
+    kak_assert(SearchIndex::get_if_up_to_date(buffer, "bar") == index);
+    kak_assert(SearchIndex::get_if_up_to_date(buffer, "foo") == nullptr);
+
+    buffer.insert(buffer.iterator_at({1,3}), "\nbar");
+    kak_assert(SearchIndex::get_if_up_to_date(buffer, "bar") == nullptr);
+    kak_assert(check("bar") == 5);
+    buffer.erase(buffer.iterator_at({0,5}), buffer.iterator_at({2,0}));
+    kak_assert(check("bar") == 3);
+
+    // matches starting well before a modification are searched again
+    buffer.reload({ "a\n", "\n", "\n", "b\n" });
+    kak_assert(check("a\\n\\n\\nb") == 1);
+    buffer.insert(buffer.iterator_at({3,1}), "c");
+    kak_assert(check("a\\n\\n\\nb") == 1);
+
+    SearchIndex::drop(buffer);
+    kak_assert(SearchIndex::get_if_up_to_date(buffer, "a\\n\\n\\nb") == nullptr);
+
+    // the index selects the same match as searching the regex from the
+    // selection, which it falls back to from inside a match or when the
+    // regex looks around its matches
+    buffer.reload({ "a bar\n", "ab\n" });
+    auto same_next_match = [&](StringView regex, ByteCoord coord) {
+        const SearchIndex* index = SearchIndex::get(buffer, regex);
+        const Selection sel{coord, coord};
+        Selection with_index = find_next_match<Forward>(buffer, sel, *index);
+        Selection with_regex = find_next_match<Forward>(buffer, sel, index->regex());
+        if (with_index.min() != with_regex.min() or with_index.max() != with_regex.max())
+            return false;
+        with_index = find_next_match<Backward>(buffer, sel, *index);
+        with_regex = find_next_match<Backward>(buffer, sel, index->regex());
+        return with_index.min() == with_regex.min() and with_index.max() == with_regex.max();
+    };
+    kak_assert(same_next_match("\\w+", {0,3}));
+    kak_assert(same_next_match("a*", {0,1}));
+    kak_assert(same_next_match("(?<=ba)r", {1,0}));
+    kak_assert(same_next_match("\\w\\b", {0,2}));
 }
 
 void test_undo_group_optimizer()
@@ -71,6 +267,422 @@ void test_undo_group_optimizer()
         kak_assert(lines[i] == buffer[LineCount((int)i)]);
 }
 
+void test_insert_coalescing()
+{
+    Buffer buffer("test", Buffer::Flags::None, { "allo ?\n", "mais que fais la police\n" });
+    // two cursors typing, the first one before the second
+    ByteCoord cursors[] = { {0, 5}, {1, 5} };
+    for (auto text : { "a", "b", "\n", "c" })
+    {
+        for (auto& cursor : cursors)
+        {
+            auto end = buffer.insert(buffer.iterator_at(cursor), text);
+            auto& change = buffer.changes_since(buffer.timestamp() - 1)[0];
+            for (auto& other : cursors)
+            {
+                if (&other != &cursor and other >= cursor)
+                    other = other.line == cursor.line ?
+                        ByteCoord{change.end.line, change.end.column + other.column - cursor.column}
+                      : ByteCoord{other.line + change.end.line - cursor.line, other.column};
+            }
+            cursor = change.end;
+        }
+    }
+    kak_assert(buffer.line_count() == 4);
+    kak_assert(buffer[0_line] == "allo ab\n" and buffer[1_line] == "c?\n");
+    kak_assert(buffer[2_line] == "mais ab\n" and buffer[3_line] == "cque fais la police\n");
+
+    buffer.undo();
+    kak_assert(buffer.line_count() == 2 and buffer[0_line] == "allo ?\n" and
+               buffer[1_line] == "mais que fais la police\n");
+    buffer.redo();
+    kak_assert(buffer.line_count() == 4 and buffer[3_line] == "cque fais la police\n");
+}
+
+void test_batched_undo()
+{
+    std::vector<String> lines = { "allo ?\n", "mais que fais la police\n",  " hein ?\n", " youpi\n", "kanaky\n" };
+    Buffer buffer("test", Buffer::Flags::None, lines);
+    auto content = [&] { return buffer.string({0,0}, buffer.end_coord()); };
+    const String original = content();
+
+    SelectionList sels{buffer, { Selection{{0, 1}, {0, 2}}, Selection{{0, 5}, {1, 3}},
+                                 Selection{{2, 1}, {2, 4}}, Selection{{3, 0}} }};
+    sels.insert(String{"X\nY"}, InsertMode::Replace);
+    buffer.commit_undo_group();
+    const String modified = content();
+    kak_assert(modified == "aX\nYo X\nY que fais la police\n X\nY ?\nX\nYyoupi\nkanaky\n");
+
+    // follows the 'k' of kanaky through undo and redo
+    SelectionList tracked{buffer, Selection{{7, 0}}};
+    buffer.undo();
+    kak_assert(content() == original);
+    tracked.update();
+    kak_assert(tracked.main().cursor() == ByteCoord{4 COMMA 0});
+    buffer.redo();
+    kak_assert(content() == modified);
+    tracked.update();
+    kak_assert(tracked.main().cursor() == ByteCoord{7 COMMA 0});
+}
+
+void test_selection_insert()
+{
+    Buffer buffer("test", Buffer::Flags::None, { "allo ?\n", "mais que fais la police\n" });
+    auto content = [&] { return buffer.string({0,0}, buffer.end_coord()); };
+    const String original = content();
+
+    // two cursors at the same point, as after o with two selections on a line
+    SelectionList sels{buffer, { Selection{{0, 4}}, Selection{{0, 4}}, Selection{{1, 4}} }};
+    for (auto text : { "a", "b", "\n", "c" })
+        sels.insert(String{text}, InsertMode::InsertCursor);
+    kak_assert(content() == "alloab\ncab\nc ?\nmaisab\nc que fais la police\n");
+    kak_assert(sels[0].cursor() == ByteCoord{1 COMMA 1});
+    kak_assert(sels[1].cursor() == ByteCoord{2 COMMA 1});
+    kak_assert(sels[2].cursor() == ByteCoord{4 COMMA 1});
+
+    // the inserts of each cursor were extended, the group undoes at once
+    buffer.commit_undo_group();
+    buffer.undo();
+    kak_assert(content() == original);
+    buffer.redo();
+    kak_assert(content() == "alloab\ncab\nc ?\nmaisab\nc que fais la police\n");
+
+    Buffer lines("lines", Buffer::Flags::None, { "ab cd\n", "ef\n" });
+    SelectionList words{lines, { Selection{{0, 0}, {0, 1}}, Selection{{0, 3}, {0, 4}},
+                                 Selection{{1, 0}, {1, 1}} }};
+    words.insert(String{"x"}, InsertMode::OpenLineBelow, true);
+    kak_assert(lines.string({0,0}, lines.end_coord()) == "ab cd\nx\nx\nef\nx\n");
+    kak_assert(words[1].min() == ByteCoord{2 COMMA 0} and words[1].max() == ByteCoord{2 COMMA 0});
+    words.insert(String{"!"}, InsertMode::AppendAtLineEnd);
+    kak_assert(lines.string({0,0}, lines.end_coord()) == "ab cd\nx!\nx!\nef\nx!\n");
+    words.erase();
+    kak_assert(lines.string({0,0}, lines.end_coord()) == "ab cd\n!\n!\nef\n!\n");
+}
+
+void test_change_compaction()
+{
+    Buffer buffer("test", Buffer::Flags::None, { "allo ?\n" });
+    const size_t start = buffer.timestamp();
+    SelectionList sels{buffer, Selection{{0, 5}}};
+
+    auto type = [&](int count) {
+        for (int i = 0; i < count; ++i)
+            buffer.insert(buffer.iterator_at({0, 0}), "x");
+        buffer.commit_undo_group();
+        buffer.compact_changes(8);
+    };
+
+    // changes needed by sels are kept
+    type(10);
+    kak_assert(buffer.timestamp() == start + 10);
+    kak_assert(buffer.changes_available_since(start));
+    sels.update();
+    kak_assert(sels.main().cursor() == ByteCoord{0 COMMA 15});
+
+    type(10);
+    kak_assert(buffer.timestamp() == start + 20);
+    kak_assert(not buffer.changes_available_since(start));
+    kak_assert(buffer.changes_since(start + 10).size() == 10);
+    sels.update();
+    kak_assert(sels.main().cursor() == ByteCoord{0 COMMA 25});
+}
+
+void test_diff()
+{
+    auto check = [](std::vector<String> a, std::vector<String> b, int max_cost) {
+        auto diff = find_diff((int)a.size(), (int)b.size(),
+                              [&](int i, int j) { return a[i] == b[j]; }, max_cost);
+        std::vector<String> res;
+        int pos = 0;
+        for (auto& op : diff)
+        {
+            if (op.mode == Diff::Keep)
+                res.insert(res.end(), a.begin() + pos, a.begin() + pos + op.len);
+            if (op.mode == Diff::Add)
+                res.insert(res.end(), b.begin() + op.posB, b.begin() + op.posB + op.len);
+            if (op.mode != Diff::Add)
+                pos += op.len;
+        }
+        kak_assert(pos == (int)a.size() and res == b);
+        return diff.size();
+    };
+    kak_assert(check({"a", "b", "c"}, {"a", "b", "c"}, 10) == 1);
+    kak_assert(check({"a", "b", "c"}, {"a", "x", "c"}, 10) == 4);
+    kak_assert(check({"a", "b", "c", "d"}, {"b", "d", "e"}, 10) == 5);
+    check({}, {"a"}, 10);
+    check({"a"}, {}, 10);
+    check({"a", "b", "c", "d", "e"}, {"e", "d", "c", "b", "a"}, 10);
+    // over max cost, middle part gets fully replaced
+    kak_assert(check({"a", "b", "c", "d", "e"}, {"a", "c", "x", "d", "e"}, 1) == 4);
+}
+
+void test_reload()
+{
+    std::vector<String> lines = { "allo ?\n", "mais que fais la police\n",  " hein ?\n", " youpi\n" };
+    std::vector<String> new_lines = { "mais que fais la police\n", "tchou\n", " hein ?\n", " youpi\n", "kanaky\n" };
+    auto has_lines = [](const Buffer& buffer, const std::vector<String>& lines) {
+        if ((int)buffer.line_count() != lines.size())
+            return false;
+        for (size_t i = 0; i < lines.size(); ++i)
+        {
+            if (buffer[LineCount((int)i)] != lines[i])
+                return false;
+        }
+        return true;
+    };
+    Buffer buffer("test", Buffer::Flags::None, lines);
+    buffer.insert(buffer.end(), "unsaved\n");
+    buffer.reload(new_lines);
+    kak_assert(not buffer.is_modified());
+    kak_assert(has_lines(buffer, new_lines));
+
+    // reloading is a single undo group
+    buffer.undo();
+    kak_assert(buffer.line_count() == 5 and buffer[4_line] == "unsaved\n");
+    buffer.redo();
+    kak_assert(has_lines(buffer, new_lines));
+
+    buffer.reload({"\n"});
+    kak_assert(buffer.line_count() == 1 and buffer[0_line] == "\n");
+}
+
+void test_undo_store()
+{
+    // spilling is not tested, as it creates a temporary file
+    UndoStore store;
+    auto content = store.store("tchou");
+    kak_assert(store.memory() == 5 and store.can_append(content));
+    kak_assert(store.append(content, "\n") and store.get(content) == "tchou\n");
+    auto shared = content;
+    kak_assert(not store.append(shared, "!") and store.get(shared) == "tchou\n");
+    kak_assert(store.memory() == 6 and store.spilled() == 0);
+
+    Buffer buffer("test", Buffer::Flags::None, { "allo ?\n", "mais que fais la police\n" });
+    buffer.insert(buffer.iterator_at({1, 0}), "tchou\n");
+    buffer.commit_undo_group();
+    buffer.erase(buffer.begin(), buffer.iterator_at({1, 0}));
+    buffer.commit_undo_group();
+
+    buffer.undo();
+    buffer.undo();
+    kak_assert(buffer.line_count() == 2 and buffer[0_line] == "allo ?\n");
+    buffer.redo();
+    kak_assert(buffer.line_count() == 3 and buffer[1_line] == "tchou\n");
+}
+
+void test_line_list()
+{
+    // two blocks of lines
+    std::vector<String> reference;
+    for (int i = 0; i < 600; ++i)
+        reference.push_back(to_string(i) + "\n");
+    LineList lines;
+    lines.assign(reference);
+    kak_assert(lines.block_count() == 2);
+
+    // lazily loaded lines, using various end of lines
+    String data;
+    std::vector<size_t> starts;
+    ByteCount reference_bytes = 0;
+    for (int i = 0; i < 520; ++i)
+    {
+        starts.push_back((int)data.length());
+        data += to_string(i);
+        reference_bytes += reference[i].length();
+        if (i == 519)
+            break;
+        data += i % 3 == 0 ? "\r\n" : (i % 7 == 0 ? "\r" : "\n");
+    }
+
+    std::vector<const char*> line_starts;
+    for (auto start : starts)
+        line_starts.push_back(data.data() + start);
+    auto read_from = [](const String& source) -> LineList::LazyReader {
+        return [&source](size_t offset, size_t length, char* buffer) {
+            if (offset + length > (int)source.length())
+                throw runtime_error("truncated");
+            std::copy(source.data() + offset, source.data() + offset + length, buffer);
+        };
+    };
+    String source = data;
+    LineList lazy_lines;
+    lazy_lines.assign(data, line_starts, read_from(source));
+    lazy_lines.check_invariant();
+    kak_assert(lazy_lines.is_lazy());
+    kak_assert(lazy_lines.size() == 520);
+    kak_assert(lazy_lines.byte_count() == reference_bytes);
+    kak_assert(lazy_lines.back() == "519\n");
+
+    // failing to read lines leaves their block to be loaded
+    source = "";
+    bool read_failed = false;
+    try
+    {
+        lazy_lines[10];
+    }
+    catch (runtime_error&)
+    {
+        read_failed = true;
+    }
+    kak_assert(read_failed and lazy_lines.is_lazy());
+    source = data;
+    kak_assert(lazy_lines[10] == "10\n");
+    lazy_lines.erase(5, 515);
+    lazy_lines.check_invariant();
+    kak_assert(lazy_lines[5] == "515\n");
+    std::vector<String> lazy_reference(reference.begin(), reference.begin() + 5);
+    lazy_reference.insert(lazy_reference.end(), reference.begin() + 515, reference.begin() + 520);
+    kak_assert(std::equal(lazy_lines.begin(), lazy_lines.end(), lazy_reference.begin()));
+    kak_assert(not lazy_lines.is_lazy());
+
+    // without reader, lines are copied in packed blocks
+    LineList packed_lines;
+    packed_lines.assign(data, line_starts, nullptr);
+    packed_lines.check_invariant();
+    kak_assert(not packed_lines.is_lazy());
+    kak_assert(packed_lines.byte_count() == reference_bytes);
+    kak_assert(packed_lines.back() == "519\n");
+    kak_assert(std::equal(packed_lines.begin(), packed_lines.end(), reference.begin()));
+
+    // blocks not accessed recently get packed again, and unpacked on access
+    const size_t unpacked_memory = packed_lines.memory();
+    packed_lines.pack();
+    packed_lines.check_invariant();
+    kak_assert(packed_lines.memory() < unpacked_memory);
+    kak_assert(packed_lines.line_offset(15) == 35);
+    kak_assert(packed_lines[15] == "15\n" and packed_lines[300] == "300\n");
+    packed_lines.erase(0, 2);
+    packed_lines.check_invariant();
+    kak_assert(packed_lines[0] == "2\n");
+
+    // snapshots are not affected by later modifications
+    auto snapshot = packed_lines.snapshot();
+    packed_lines.set(0, "modified\n");
+    packed_lines.replace_in_line(10, 0, 1, "x");
+    packed_lines.insert(5, { "inserted\n" });
+    packed_lines.erase(12, 15);
+    packed_lines.pack();
+    packed_lines.check_invariant();
+    kak_assert(packed_lines[0] == "modified\n" and packed_lines[6] == "7\n");
+    kak_assert(snapshot.size() == 518 and snapshot.byte_count() == reference_bytes - 4);
+    kak_assert(snapshot[0] == "2\n" and snapshot[10] == "12\n" and snapshot[3] == "5\n");
+
+    auto check_lines = [&](int pos) {
+        lines.check_invariant();
+        kak_assert(lines.size() == (int)reference.size());
+        kak_assert(lines[pos] == reference[pos] and lines.back() == reference.back());
+
+        ByteCount offset = 0;
+        for (int j = 0; j < pos; ++j)
+            offset += reference[j].length();
+        kak_assert(lines.line_offset(pos) == offset);
+        kak_assert(lines.line_at_offset(offset) == pos);
+        kak_assert(lines.line_at_offset(offset + reference[pos].length() - 1) == pos);
+    };
+
+    // inserting in a full block splits it
+    std::vector<String> new_lines(750, "new\n");
+    reference.insert(reference.begin() + 10, new_lines.begin(), new_lines.end());
+    lines.insert(10, std::move(new_lines));
+    check_lines(700);
+    const size_t split_block_count = lines.block_count();
+    kak_assert(split_block_count > 2);
+
+    // erasing most of a block merges what is left with a neighbour
+    reference.erase(reference.begin() + 5, reference.begin() + 1100);
+    lines.erase(5, 1100);
+    check_lines(50);
+    kak_assert(lines.block_count() < split_block_count);
+
+    // small edits stay in their block
+    reference.insert(reference.begin() + 3, { "a\n", "b\n" });
+    lines.insert(3, { "a\n", "b\n" });
+    reference.erase(reference.begin() + 60, reference.begin() + 62);
+    lines.erase(60, 62);
+    check_lines(80);
+
+    // in place edits keep the byte offsets up to date
+    const ByteCount byte_count = lines.byte_count();
+    lines.replace_in_line(10, 1, 0, "abc");
+    reference[10].insert(1, "abc");
+    const int last = (int)reference.size() - 1;
+    lines.replace_in_line(last, 0, 1, "");
+    reference[last].erase(0, 1);
+    kak_assert(lines.byte_count() == byte_count + 2);
+    check_lines(last);
+    kak_assert(std::equal(lines.begin(), lines.end(), reference.begin()));
+
+    // line infos follow the edits
+    kak_assert(lines.info(10).ascii and not lines.info(10).has_tab and
+               lines.info(10).char_count == reference[10].char_length());
+    lines.replace_in_line(10, 0, 0, "\t\xC3\xA9");
+    kak_assert(not lines.info(10).ascii and lines.info(10).has_tab and
+               lines.info(10).has_unprintable);
+    kak_assert(lines.info(10).char_count == reference[10].char_length() + 2);
+    lines.set(10, "\xC3\xA9t\xC3\xA9\n");
+    kak_assert(not lines.info(10).has_tab and lines.info(10).char_count == 4);
+    lines.insert(5, { "\x01\n" });
+    kak_assert(lines.info(5).has_unprintable and lines.info(11).char_count == 4);
+    lines.erase(5, 6);
+    lines.check_invariant();
+    kak_assert(lines.info(10).char_count == 4);
+}
+
+void test_line_modifications()
+{
+    std::vector<String> lines;
+    for (int i = 0; i < 40; ++i)
+        lines.push_back("line " + to_string(i) + "\n");
+    Buffer buffer("test", Buffer::Flags::None, lines);
+
+    // lines outside of the modifications must be preserved
+    auto check = [&](const std::vector<String>& old_lines, size_t timestamp) {
+        auto modifs = compute_line_modifications(buffer, timestamp);
+        LineCount old_line = 0, diff = 0;
+        for (auto& modif : modifs)
+        {
+            kak_assert(modif.old_line >= old_line and modif.new_line == modif.old_line + diff);
+            for (; old_line < modif.old_line; ++old_line)
+                kak_assert(buffer[old_line + diff] == old_lines[(int)old_line]);
+            old_line = modif.old_line + modif.num_removed + 1;
+            diff = modif.diff();
+        }
+        for (; old_line < (int)old_lines.size(); ++old_line)
+            kak_assert(buffer[old_line + diff] == old_lines[(int)old_line]);
+        kak_assert(buffer.line_count() == diff + (int)old_lines.size());
+    };
+
+    unsigned seed = 42;
+    auto rand = [&](int max) { seed = seed * 1103515245 + 12345; return (int)((seed >> 16) % max); };
+    auto edit = [&](LineCount line) {
+        line = std::min(line, buffer.line_count() - 1);
+        if (rand(2))
+            buffer.insert(buffer.iterator_at({line, rand(4)}), rand(2) ? "x\ny\n" : "z");
+        else
+            buffer.erase(buffer.iterator_at({line, 0}),
+                         buffer.iterator_at({std::min(line + rand(3), buffer.line_count() - 1), 2}));
+    };
+
+    const size_t timestamp = buffer.timestamp();
+    // forward, backward and random order edits
+    for (int i = 0; i < 10; ++i)
+        edit(i * 4);
+    check(lines, timestamp);
+    for (int i = 10; i > 0; --i)
+        edit(i * 3);
+    check(lines, timestamp);
+
+    std::vector<String> intermediate;
+    for (auto line = 0_line; line < buffer.line_count(); ++line)
+        intermediate.push_back(buffer[line]);
+    const size_t intermediate_timestamp = buffer.timestamp();
+    for (int i = 0; i < 20; ++i)
+        edit(rand((int)buffer.line_count()));
+    // composed on top of the cached modifications
+    check(lines, timestamp);
+    check(intermediate, intermediate_timestamp);
+}
+
 void test_word_db()
 {
     Buffer buffer("test", Buffer::Flags::None,
@@ -148,6 +760,17 @@ void run_unit_tests()
     test_string();
     test_keys();
     test_buffer();
+    test_regex_search();
+    test_search_index();
     test_undo_group_optimizer();
+    test_insert_coalescing();
+    test_batched_undo();
+    test_selection_insert();
+    test_change_compaction();
+    test_diff();
+    test_reload();
+    test_undo_store();
+    test_line_list();
+    test_line_modifications();
     test_word_db();
 }
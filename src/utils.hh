@@ -5,7 +5,10 @@
 #include "exception.hh"
 
 #include <algorithm>
+#include <exception>
 #include <memory>
+#include <system_error>
+#include <thread>
 #include <vector>
 #include <unordered_set>
 
@@ -226,6 +229,72 @@ private:
     Registry* m_registry;
 };
 
+// run func(index) for index in [0, count), on up to max_threads threads, or
+// one per core when 0, thread t running the indices t, t + thread count...
+// Threads that cannot be created have their indices run on the calling
+// thread, and the first exception thrown by func is rethrown once every
+// thread is joined.
+template<typename Func>
+void run_parallel(size_t count, Func func, unsigned max_threads = 0)
+{
+    if (max_threads == 0)
+        max_threads = std::max(1u, std::thread::hardware_concurrency());
+    const size_t thread_count = std::min<size_t>(count, max_threads);
+
+    std::vector<std::exception_ptr> errors(count);
+    auto run = [&](size_t first) {
+        for (size_t i = first; i < count; i += thread_count)
+        {
+            try
+            {
+                func(i);
+            }
+            catch (...)
+            {
+                errors[i] = std::current_exception();
+            }
+        }
+    };
+
+    std::vector<std::thread> threads;
+    threads.reserve(thread_count);
+    size_t t = 1;
+    for (; t < thread_count; ++t)
+    {
+        try
+        {
+            threads.emplace_back(run, t);
+        }
+        catch (std::system_error&)
+        {
+            break;
+        }
+    }
+    for (; t < thread_count; ++t)
+        run(t);
+    run(0);
+
+    for (auto& thread : threads)
+        thread.join();
+    for (auto& error : errors)
+    {
+        if (error)
+            std::rethrow_exception(error);
+    }
+}
+
+// number of threads to process size bytes with, each of them getting
+// at least chunk_size bytes, max_threads being the number of cores when 0
+inline size_t parallel_thread_count(size_t size, size_t chunk_size,
+                                    unsigned max_threads = 0)
+{
+    if (size < chunk_size)
+        return 1;
+    if (max_threads == 0)
+        max_threads = std::thread::hardware_concurrency();
+    return std::max(1u, std::min({max_threads, 8u, (unsigned)(size / chunk_size)}));
+}
+
 }
 
 // std::pair hashing
@@ -51,6 +51,43 @@ static void remove_words(WordDB::WordList& wl, const std::vector<InternedString>
 WordDB::WordDB(const Buffer& buffer)
     : m_buffer{&buffer}, m_timestamp{buffer.timestamp()}
 {
+    m_buffer->register_change_consumer(m_timestamp);
+    rebuild_db();
+}
+
+WordDB::WordDB(const WordDB& other)
+    : m_buffer{other.m_buffer}, m_timestamp{other.m_timestamp},
+      m_words{other.m_words}, m_line_to_words{other.m_line_to_words}
+{
+    if (m_buffer)
+        m_buffer->register_change_consumer(m_timestamp);
+}
+
+WordDB::WordDB(WordDB&& other)
+    : m_timestamp{other.m_timestamp}, m_words{std::move(other.m_words)},
+      m_line_to_words{std::move(other.m_line_to_words)}
+{
+    if (other.m_buffer)
+    {
+        other.m_buffer->unregister_change_consumer(other.m_timestamp);
+        m_buffer = std::move(other.m_buffer);
+        m_buffer->register_change_consumer(m_timestamp);
+    }
+}
+
+WordDB::~WordDB()
+{
+    if (m_buffer)
+        m_buffer->unregister_change_consumer(m_timestamp);
+}
+
+void WordDB::rebuild_db()
+{
+    auto& buffer = *m_buffer;
+
+    m_timestamp = buffer.timestamp();
+    m_words.clear();
+    m_line_to_words.clear();
     m_line_to_words.reserve((int)buffer.line_count());
     for (auto line = 0_line, end = buffer.line_count(); line < end; ++line)
     {
@@ -63,6 +100,10 @@ void WordDB::update_db()
 {
     auto& buffer = *m_buffer;
 
+    // we lagged too far behind, changes were compacted away
+    if (not buffer.changes_available_since(m_timestamp))
+        return rebuild_db();
+
     auto modifs = compute_line_modifications(buffer, m_timestamp);
     m_timestamp = buffer.timestamp();
 
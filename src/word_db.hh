@@ -14,6 +14,10 @@ class WordDB
 {
 public:
     WordDB(const Buffer& buffer);
+    WordDB(const WordDB& other);
+    WordDB(WordDB&& other);
+    WordDB& operator=(const WordDB&) = delete;
+    ~WordDB();
 
     std::vector<InternedString> find_prefix(StringView prefix);
     std::vector<InternedString> find_subsequence(StringView subsequence);
@@ -24,6 +28,7 @@ private:
     using LineToWords = std::vector<std::vector<InternedString>>;
 
     void update_db();
+    void rebuild_db();
 
     safe_ptr<const Buffer> m_buffer;
     size_t m_timestamp;